@@ -0,0 +1,68 @@
+// scalar vs vector elementwise kernels
+// g++ -std=c++17 -O2 -I.. kernels.cpp -o kernels && ./kernels
+#include "kernels.hpp"
+#include "dense.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace matlang;
+
+static const char *name(kernels::isa level) {
+	switch (level) {
+	case kernels::isa::sse2:
+		return "sse2";
+	case kernels::isa::avx2:
+		return "avx2";
+	case kernels::isa::avx512:
+		return "avx512";
+	default:
+		return "scalar";
+	}
+}
+
+template <typename Fn> static double seconds(size_t repeat, Fn &&fn) {
+	auto start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < repeat; r++)
+		fn();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+	                                     start)
+	           .count();
+}
+
+int main() {
+	const kernels::isa levels[] = {kernels::isa::scalar, kernels::isa::sse2,
+	                               kernels::isa::avx2, kernels::isa::avx512};
+	for (size_t n : {1000, 100000, 10000000}) {
+		// one extra element to also time a misaligned start
+		aligned_buffer a(n + 1), b(n + 1), out(n + 1), expected(n + 1);
+		for (size_t i = 0; i <= n; i++) {
+			a.data()[i] = std::sin(i);
+			b.data()[i] = std::cos(i);
+		}
+		size_t repeat = 100000000 / n + 1;
+		kernels::select(kernels::isa::scalar)
+		    .add(expected.data(), a.data(), b.data(), n + 1);
+		std::printf("n = %zu, %zu runs\n", n, repeat);
+		for (auto level : levels) {
+			if (!kernels::supported(level))
+				continue;
+			auto t = kernels::select(level);
+			for (size_t offset : {0, 1}) {
+				double add = seconds(repeat, [&] {
+					t.add(out.data() + offset, a.data() + offset, b.data() + offset, n);
+				});
+				bool ok = std::equal(out.data() + offset, out.data() + offset + n,
+				                     expected.data() + offset);
+				double scale = seconds(repeat, [&] {
+					t.scale(out.data() + offset, a.data() + offset, 2.0, n);
+				});
+				std::printf("  %-7s %s add %8.3f GB/s  scale %8.3f GB/s%s\n",
+				            name(level), offset ? "unaligned" : "aligned  ",
+				            3.0 * sizeof(double) * n * repeat / add / 1e9,
+				            2.0 * sizeof(double) * n * repeat / scale / 1e9,
+				            ok ? "" : "  MISMATCH");
+			}
+		}
+	}
+}
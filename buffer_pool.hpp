@@ -0,0 +1,234 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace matlang {
+namespace pool_impl {
+constexpr size_t alignment = 64;
+// 1 to 4 lines exactly, then four classes per doubling
+constexpr size_t class_of(size_t bytes, size_t *rounded = nullptr) {
+	size_t lines = (bytes + alignment - 1) / alignment, size = lines;
+	size_t c = lines - 1;
+	if (lines > 4) {
+		size_t shift = 61 - __builtin_clzll(lines - 1);
+		size_t q = (lines + (size_t{1} << shift) - 1) >> shift;
+		size = q << shift;
+		c = 4 + shift * 4 + (q - 5);
+	}
+	if (rounded)
+		*rounded = size * alignment;
+	return c;
+}
+} // namespace pool_impl
+
+// cache-line aligned blocks recycled by size class, so the temporaries of one
+// statement are reused by the next without reaching malloc; one cache per
+// thread, a block freed on another thread joins that thread's cache. blocks
+// in use and cached ones are counted process wide, rounded up to their class.
+// a limit caps the bytes in use, allocations past it fail before they reach
+// the system; cached blocks are kept only below it, and once they would take
+// the total past it every thread returns its cache to the system the next
+// time it allocates or releases
+class buffer_pool {
+public:
+	constexpr static size_t alignment = pool_impl::alignment;
+	// larger blocks go straight to the system, rounded to a cache line only
+	constexpr static size_t max_bytes = size_t{1} << 26;
+	// cached bytes kept per thread
+	constexpr static size_t cache_limit = size_t{1} << 27;
+
+	static void *allocate(size_t bytes) {
+		if (bytes == 0)
+			return nullptr;
+		size_t rounded;
+		size_t c = class_of(bytes, rounded);
+		cache *self = c < classes ? local_cache() : nullptr;
+		if (self && !self->free[c].empty()) {
+			void *p = self->free[c].back();
+			self->free[c].pop_back();
+			self->cached -= rounded;
+			totals().cached -= rounded;
+			totals().used += rounded;
+			return p;
+		}
+		charge(rounded);
+		void *p = std::aligned_alloc(alignment, rounded);
+		if (!p) {
+			discharge(rounded);
+			throw std::bad_alloc{};
+		}
+		return p;
+	}
+	static void release(void *p, size_t bytes) noexcept {
+		if (!p)
+			return;
+		size_t rounded;
+		size_t c = class_of(bytes, rounded);
+		discharge(rounded);
+		cache *self = c < classes ? local_cache() : nullptr;
+		size_t limit = totals().limit;
+		if (!self || self->cached + rounded > cache_limit ||
+		    (limit != 0 && held() + rounded > limit)) {
+			std::free(p);
+			return;
+		}
+		try {
+			self->free[c].push_back(p);
+			self->cached += rounded;
+			totals().cached += rounded;
+		} catch (...) {
+			std::free(p);
+		}
+	}
+	// bytes held for reuse by the calling thread
+	static size_t cached() { return finished() ? 0 : local().cached; }
+	// returns the calling thread's cached blocks to the system
+	static void trim() {
+		if (!finished())
+			local().trim();
+	}
+
+	// what a block of bytes takes, its size class rounded up
+	static size_t rounded(size_t bytes) {
+		size_t result = 0;
+		if (bytes != 0)
+			class_of(bytes, result);
+		return result;
+	}
+	// bytes in use by all threads, cached blocks excluded
+	static size_t in_use() { return totals().used; }
+	// bytes in use and cached by all threads
+	static size_t held() { return totals().used + totals().cached; }
+	// 0 for none
+	static size_t limit() { return totals().limit; }
+	// every cache is emptied, so what the threads held before fits it
+	static void set_limit(size_t bytes) {
+		totals().limit = bytes;
+		totals().trims++;
+	}
+	// counts bytes allocated elsewhere as in use, throws instead when they
+	// would take in_use() past the limit; past it together with the cached
+	// blocks, all caches are asked to empty
+	static void charge(size_t bytes) {
+		auto &t = totals();
+		size_t used = t.used += bytes;
+		size_t limit = t.limit;
+		if (limit == 0)
+			return;
+		if (used > limit) {
+			t.used -= bytes;
+			throw std::invalid_argument{"memory limit of " + std::to_string(limit) +
+			                            " bytes exceeded"};
+		}
+		if (used + t.cached > limit) {
+			t.trims++;
+			local_cache();
+		}
+	}
+	static void discharge(size_t bytes) noexcept { totals().used -= bytes; }
+
+private:
+	constexpr static size_t classes = pool_impl::class_of(max_bytes) + 1;
+	// blocks of the classes never cached only round up to a cache line
+	static size_t class_of(size_t bytes, size_t &size) {
+		size_t c = pool_impl::class_of(bytes, &size);
+		if (c >= classes)
+			size = (bytes + alignment - 1) / alignment * alignment;
+		return c;
+	}
+
+	struct cache {
+		std::array<std::vector<void *>, classes> free{};
+		size_t cached{};
+		size_t trims{}; // requests to empty it seen so far
+		void trim() {
+			totals().cached -= cached;
+			for (auto &list : free) {
+				for (void *p : list)
+					std::free(p);
+				list.clear();
+			}
+			cached = 0;
+		}
+		~cache() {
+			trim();
+			finished() = true;
+		}
+	};
+	// set once the thread's cache is destroyed, later frees bypass it
+	static bool &finished() {
+		thread_local bool flag = false;
+		return flag;
+	}
+	static cache &local() {
+		thread_local cache instance;
+		return instance;
+	}
+	// the calling thread's cache, emptied first if that was asked for since
+	// the last call; nullptr once it is destroyed
+	static cache *local_cache() {
+		if (finished())
+			return nullptr;
+		auto &self = local();
+		if (size_t trims = totals().trims; self.trims != trims) {
+			self.trim();
+			self.trims = trims;
+		}
+		return &self;
+	}
+	struct account {
+		std::atomic<size_t> used{}, cached{}, limit{}, trims{};
+	};
+	// MATLANG_MEMORY_LIMIT sets the initial limit in bytes
+	static account &totals() {
+		static account instance{{0}, {0}, {limit_from_env()}, {0}};
+		return instance;
+	}
+	static size_t limit_from_env() {
+		if (const char *env = std::getenv("MATLANG_MEMORY_LIMIT"))
+			if (long long n = std::atoll(env); n > 0)
+				return n;
+		return 0;
+	}
+};
+
+// std::allocator whose blocks are counted by the pool, for storage that
+// grows in place like the arrays of sparse matrices and nested containers
+template <typename T> struct counted_allocator {
+	using value_type = T;
+
+	counted_allocator() = default;
+	template <typename U> counted_allocator(const counted_allocator<U> &) {}
+
+	T *allocate(size_t n) {
+		buffer_pool::charge(n * sizeof(T));
+		try {
+			return std::allocator<T>{}.allocate(n);
+		} catch (...) {
+			buffer_pool::discharge(n * sizeof(T));
+			throw;
+		}
+	}
+	void deallocate(T *p, size_t n) noexcept {
+		std::allocator<T>{}.deallocate(p, n);
+		buffer_pool::discharge(n * sizeof(T));
+	}
+	template <typename U> bool operator==(const counted_allocator<U> &) const {
+		return true;
+	}
+	template <typename U> bool operator!=(const counted_allocator<U> &) const {
+		return false;
+	}
+};
+template <typename T> using counted_vector = std::vector<T, counted_allocator<T>>;
+} // namespace matlang
+
+#endif /* end of include guard: BUFFER_POOL_HPP */
@@ -0,0 +1,259 @@
+#ifndef BUILTINS_HPP
+#define BUILTINS_HPP
+
+#include "object.hpp"
+#include "reduce.hpp"
+#include "thread_pool.hpp"
+#include <cmath>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace matlang {
+// native functions callable as name(args), resolved when a statement compiles
+namespace builtins {
+using function = object (*)(const std::vector<object> &args);
+
+struct builtin {
+	const char *name;
+	size_t min_args, max_args;
+	function fn;
+};
+
+namespace impl {
+using line_fn = double (*)(const reduce::line &);
+
+// all elements of a ragged object in order
+inline void flatten(const object &o, std::vector<double> &out) {
+	if (o.flat())
+		out.push_back(o.value());
+	else if (o.sparse())
+		throw std::invalid_argument{"dense operand expected"};
+	else if (o.typed())
+		flatten(object(o.typed_data().widen()), out);
+	else if (o.packed()) {
+		auto &d = o.packed_data();
+		out.insert(out.end(), d.data(), d.data() + d.count());
+	} else
+		o.visit([&](auto &a) {
+			if constexpr (std::is_same_v<std::decay_t<decltype(a)>,
+			                             object::container_impl>)
+				for (auto &b : a)
+					flatten(b, out);
+		});
+}
+// every element as one line, ragged objects are gathered first and typed ones
+// widened
+template <typename Fn> auto with_elements(const object &o, const Fn &fn) {
+	if (o.packed()) {
+		auto &d = o.packed_data();
+		return fn(reduce::line{d.data(), d.count(), 1});
+	}
+	if (o.typed()) {
+		auto d = o.typed_data().widen();
+		return fn(reduce::line{d.data(), d.count(), 1});
+	}
+	std::vector<double> all;
+	flatten(o, all);
+	if (all.empty())
+		throw std::invalid_argument{"empty operand"};
+	return fn(reduce::line{all.data(), all.size(), 1});
+}
+
+inline size_t axis_of(const object &a) {
+	if (!a.flat() || a.value() < 0 || a.value() != std::floor(a.value()))
+		throw std::invalid_argument{"invalid axis"};
+	return size_t(a.value());
+}
+inline size_t axis_length(const object &o, const std::vector<object> &args) {
+	if (args.size() == 1 && o.sparse())
+		return o.sparse_data().rows() * o.sparse_data().columns();
+	if (args.size() == 1)
+		return with_elements(o, [](const reduce::line &l) { return l.n; });
+	if (!o.packed() && !o.typed())
+		throw std::invalid_argument{"dense operand expected"};
+	auto &shape = o.typed() ? o.typed_data().shape() : o.packed_data().shape();
+	size_t axis = axis_of(args[1]);
+	if (axis >= shape.size())
+		throw std::invalid_argument{"invalid axis"};
+	return shape[axis];
+}
+// the nonzeros and a single zero for all the others, which gives the same
+// sum, product, extremes and norm as every element would
+inline double sparse_elements(const sparse &s, line_fn f) {
+	std::vector<double> line(s.values().begin(), s.values().end());
+	if (line.size() != s.rows() * s.columns())
+		line.push_back(0.0);
+	return f({line.data(), line.size(), 1});
+}
+
+// f over all elements, or over every line along args[1]; typed operands are
+// reduced in float64
+inline object reduction(const std::vector<object> &args, line_fn f) {
+	auto &o = args[0];
+	if (o.typed()) {
+		auto widened = args;
+		widened[0] = object(o.typed_data().widen());
+		return reduction(widened, f);
+	}
+	if (args.size() == 1 && o.sparse())
+		return object(sparse_elements(o.sparse_data(), f));
+	if (args.size() == 1)
+		return object(with_elements(o, f));
+	size_t axis = axis_of(args[1]);
+	if (!o.packed())
+		throw std::invalid_argument{"dense operand expected"};
+	auto &d = o.packed_data();
+	if (axis >= d.rank())
+		throw std::invalid_argument{"invalid axis"};
+	if (d.rank() == 1)
+		return object(f({d.data(), d.count(), 1}));
+	shape_t shape = d.shape();
+	size_t n = shape[axis], inner = d.strides()[axis];
+	shape.erase(shape.begin() + axis);
+	dense result(shape);
+	double *out = result.data();
+	const double *in = d.data();
+	pool().parallel_for(
+	    result.count(), std::max<size_t>(1, thread_pool::grain / n),
+	    [&](size_t begin, size_t end) {
+		    for (size_t j = begin; j < end; j++)
+			    out[j] = f({in + j / inner * n * inner + j % inner, n, inner});
+	    });
+	return object(std::move(result));
+}
+inline object scaled(object o, double f) {
+	if (o.flat())
+		return object(o.value() * f);
+	return o * object(f);
+}
+
+inline object sum(const std::vector<object> &args) {
+	return reduction(args, [](const reduce::line &l) { return reduce::sum(l); });
+}
+inline object prod(const std::vector<object> &args) {
+	return reduction(args, [](const reduce::line &l) { return reduce::prod(l); });
+}
+inline object min(const std::vector<object> &args) {
+	return reduction(args, [](const reduce::line &l) { return reduce::min(l); });
+}
+inline object max(const std::vector<object> &args) {
+	return reduction(args, [](const reduce::line &l) { return reduce::max(l); });
+}
+inline object mean(const std::vector<object> &args) {
+	return scaled(sum(args), 1.0 / axis_length(args[0], args));
+}
+inline object norm(const std::vector<object> &args) {
+	return reduction(args, [](const reduce::line &l) {
+		return std::sqrt(reduce::sum_squares(l));
+	});
+}
+// sizes are positive integers
+inline size_t count_of(const object &a) {
+	if (!a.flat() || a.value() < 1 || a.value() != std::floor(a.value()))
+		throw std::invalid_argument{"invalid size"};
+	return size_t(a.value());
+}
+// sparse(matrix), sparse(rows, columns) of zeros, or sparse(rows, columns, i,
+// j, values) from coordinates where repeated positions add up
+inline object make_sparse(const std::vector<object> &args) {
+	if (args.size() == 1) {
+		if (args[0].sparse())
+			return args[0];
+		if (args[0].typed())
+			return object(sparse::from_dense(args[0].typed_data().widen().view()));
+		if (!args[0].packed())
+			throw std::invalid_argument{"matrix operand expected"};
+		return object(sparse::from_dense(args[0].packed_data().view()));
+	}
+	size_t rows = count_of(args[0]), columns = count_of(args[1]);
+	if (args.size() == 2)
+		return object(sparse(rows, columns));
+	if (args.size() != 5)
+		throw std::invalid_argument{"sparse takes 1, 2 or 5 arguments"};
+	std::vector<std::vector<double>> lists(3);
+	for (size_t k = 0; k != 3; k++)
+		flatten(args[k + 2], lists[k]);
+	if (lists[0].size() != lists[2].size() || lists[1].size() != lists[2].size())
+		throw std::invalid_argument{"size mismatch"};
+	std::vector<sparse::entry> entries;
+	entries.reserve(lists[2].size());
+	for (size_t p = 0; p != lists[2].size(); p++) {
+		double i = lists[0][p], j = lists[1][p];
+		if (i < 0 || j < 0 || i != std::floor(i) || j != std::floor(j))
+			throw std::invalid_argument{"invalid index"};
+		entries.push_back({size_t(i), size_t(j), lists[2][p]});
+	}
+	return object(sparse::from_entries(rows, columns, std::move(entries)));
+}
+inline object full(const std::vector<object> &args) {
+	if (args[0].sparse())
+		return object(args[0].sparse_data().to_dense());
+	return args[0];
+}
+inline object nnz(const std::vector<object> &args) {
+	if (args[0].sparse())
+		return object(double(args[0].sparse_data().nnz()));
+	return object(with_elements(args[0], [](const reduce::line &l) {
+		size_t n = 0;
+		for (size_t i = 0; i != l.n; i++)
+			n += l.data[i * l.stride] != 0;
+		return double(n);
+	}));
+}
+// float32(x), float64(x) and int64(x) store the elements of x as that type,
+// scalars stay doubles rounded the same way
+template <dtype type> object convert(const std::vector<object> &args) {
+	auto &o = args[0];
+	if (o.flat()) {
+		if (type == dtype::float32)
+			return object(double(float(o.value())));
+		if (type == dtype::int64)
+			return object(double(typed_dense::to_int64(o.value())));
+		return o;
+	}
+	if (o.typed() && o.typed_data().type() == type)
+		return o;
+	if (o.typed() && type == dtype::float64)
+		return object(o.typed_data().widen());
+	if (o.typed())
+		return object(typed_dense::from(o.typed_data().widen().view(), type));
+	if (!o.packed())
+		throw std::invalid_argument{"dense operand expected"};
+	if (type == dtype::float64)
+		return o;
+	return object(typed_dense::from(o.packed_data().view(), type));
+}
+inline object dot(const std::vector<object> &args) {
+	return object(with_elements(args[0], [&](const reduce::line &a) {
+		return with_elements(args[1], [&](const reduce::line &b) {
+			if (a.n != b.n)
+				throw std::invalid_argument{"size mismatch"};
+			return reduce::dot(a, b);
+		});
+	}));
+}
+} // namespace impl
+
+// nullptr for an unknown name
+inline const builtin *find(std::string_view name) {
+	static const builtin table[] = {
+	    {"sum", 1, 2, impl::sum},   {"prod", 1, 2, impl::prod},
+	    {"min", 1, 2, impl::min},   {"max", 1, 2, impl::max},
+	    {"mean", 1, 2, impl::mean}, {"norm", 1, 2, impl::norm},
+	    {"dot", 2, 2, impl::dot},   {"sparse", 1, 5, impl::make_sparse},
+	    {"full", 1, 1, impl::full}, {"nnz", 1, 1, impl::nnz},
+	    {"float32", 1, 1, impl::convert<dtype::float32>},
+	    {"float64", 1, 1, impl::convert<dtype::float64>},
+	    {"int64", 1, 1, impl::convert<dtype::int64>},
+	};
+	for (auto &b : table)
+		if (name == b.name)
+			return &b;
+	return nullptr;
+}
+} // namespace builtins
+} // namespace matlang
+
+#endif /* end of include guard: BUILTINS_HPP */
@@ -0,0 +1,273 @@
+#ifndef CSV_HPP
+#define CSV_HPP
+
+#include "dense.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace matlang {
+// numeric text tables: one row per line, fields separated by commas, blank
+// lines ignored, a first line that does not parse is a header and skipped;
+// files are read in fixed-size chunks whose lines parse in parallel
+namespace csv {
+constexpr size_t chunk_bytes = size_t{1} << 22;
+
+namespace impl {
+constexpr size_t none = ~size_t{0};
+
+// parsed run of consecutive lines, line numbers are relative to it
+struct block {
+	size_t rows{}, lines{};
+	size_t error_line{none};
+	std::string error{};
+};
+
+constexpr bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool blank(std::string_view line) {
+	return std::all_of(line.begin(), line.end(), is_blank);
+}
+// number of fields of a line, the first room of them written to out; none
+// when one is not a number
+inline size_t parse_line(std::string_view line, double *out, size_t room) {
+	size_t i = 0, n = 0;
+	while (true) {
+		while (i < line.size() && is_blank(line[i]))
+			i++;
+		if (i < line.size() && line[i] == '+')
+			i++;
+		size_t end = i;
+		while (end < line.size() && line[end] != ',' && !is_blank(line[end]))
+			end++;
+		double v;
+		if (!lexer::to_double(line.substr(i, end - i), v))
+			return none;
+		if (n < room)
+			out[n] = v;
+		n++;
+		for (i = end; i < line.size() && is_blank(line[i]);)
+			i++;
+		if (i == line.size())
+			return n;
+		if (line[i] != ',')
+			return none;
+		i++;
+	}
+}
+// lines of text, the last one may lack its '\n'
+inline size_t count_lines(std::string_view text) {
+	size_t n = std::count(text.begin(), text.end(), '\n');
+	return n + (!text.empty() && text.back() != '\n');
+}
+// rows of columns fields each written to out, which has room for every line
+inline block parse(std::string_view text, size_t columns, double *out) {
+	block b;
+	for (size_t pos = 0; pos < text.size(); b.lines++) {
+		size_t end = std::min(text.find('\n', pos), text.size());
+		auto line = text.substr(pos, end - pos);
+		pos = end + 1;
+		if (blank(line))
+			continue;
+		size_t n = parse_line(line, out + b.rows * columns, columns);
+		if (n == none) {
+			b.error_line = b.lines;
+			b.error = "invalid number";
+			return b;
+		}
+		if (n != columns) {
+			b.error_line = b.lines;
+			b.error = std::to_string(n) + " columns, expected " +
+			          std::to_string(columns);
+			return b;
+		}
+		b.rows++;
+	}
+	return b;
+}
+} // namespace impl
+
+// rows of a file in blocks, holding at most one chunk of text plus the rows
+// not yet returned. those are kept in pool storage, so they count against
+// the memory limit, and a block taking all of them adopts it
+class reader {
+public:
+	explicit reader(const std::string &path)
+	    : path{path}, file{std::fopen(path.c_str(), "rb"), &std::fclose} {
+		if (!file)
+			throw std::invalid_argument{"cannot open " + path};
+		// unknown for pipes, the rows are then stored by doubling
+		if (std::fseek(file.get(), 0, SEEK_END) == 0)
+			if (long end = std::ftell(file.get()); end > 0)
+				file_bytes = end;
+		std::rewind(file.get());
+	}
+
+	// the next rows x columns matrix of at most max_rows rows, false after
+	// the last one
+	bool next(size_t max_rows, dense &out) {
+		wanted = max_rows;
+		while (pending_rows() < max_rows && fill())
+			;
+		size_t rows = std::min(max_rows, pending_rows());
+		if (rows == 0)
+			return false;
+		size_t n = rows * columns;
+		if (n == filled) {
+			pending.shrink(n);
+			out = dense({rows, columns}, std::move(pending));
+			pending = aligned_buffer();
+			filled = 0;
+			return true;
+		}
+		dense result({rows, columns});
+		std::copy_n(pending.data(), n, result.data());
+		std::copy(pending.data() + n, pending.data() + filled, pending.data());
+		filled -= n;
+		out = std::move(result);
+		return true;
+	}
+
+private:
+	size_t pending_rows() const { return columns ? filled / columns : 0; }
+
+	// parses the complete lines of the next chunk, false at the end of the file
+	bool fill() {
+		if (eof)
+			return false;
+		size_t kept = text.size();
+		text.resize(kept + chunk_bytes);
+		size_t got = std::fread(text.data() + kept, 1, chunk_bytes, file.get());
+		text.resize(kept + got);
+		if (got < chunk_bytes) {
+			if (std::ferror(file.get()))
+				throw std::invalid_argument{"cannot read " + path};
+			eof = true;
+		}
+		size_t end = eof ? text.size() : text.rfind('\n') + 1;
+		std::string_view body(text.data(), end);
+		if (!started)
+			body = skip_header(body);
+		consumed += end;
+		add(body);
+		text.erase(0, end);
+		return true;
+	}
+	// the first line that is not blank is a header when it does not parse,
+	// it goes with the blank lines before it
+	std::string_view skip_header(std::string_view body) {
+		for (size_t pos = 0; pos < body.size();) {
+			size_t end = std::min(body.find('\n', pos), body.size());
+			auto first = body.substr(pos, end - pos);
+			pos = std::min(end + 1, body.size());
+			if (impl::blank(first))
+				continue;
+			started = true;
+			if (impl::parse_line(first, nullptr, 0) != impl::none)
+				return body;
+			line += std::count(body.begin(), body.begin() + pos, '\n');
+			return body.substr(pos);
+		}
+		return body;
+	}
+	// splits at line ends into one part per thread, each parsed straight
+	// into pending with room for all of its lines; the rows then close the
+	// gaps blank lines left, in file order
+	void add(std::string_view body) {
+		constexpr size_t min_part = size_t{1} << 16;
+		size_t parts = std::clamp<size_t>(body.size() / min_part, 1, pool().size());
+		std::vector<size_t> cuts{0};
+		for (size_t k = 1; k < parts; k++) {
+			size_t cut = std::min(body.find('\n', k * body.size() / parts), body.size());
+			cuts.push_back(std::max(cuts.back(), std::min(cut + 1, body.size())));
+		}
+		cuts.push_back(body.size());
+		auto part = [&](size_t k) { return body.substr(cuts[k], cuts[k + 1] - cuts[k]); };
+		if (columns == 0)
+			columns = first_columns(body);
+		std::vector<size_t> starts{filled};
+		for (size_t k = 0; k < parts; k++)
+			starts.push_back(starts.back() + impl::count_lines(part(k)) * columns);
+		parsed += starts.back() - filled;
+		reserve(starts.back());
+		double *out = pending.data();
+		std::vector<impl::block> blocks(parts);
+		pool().parallel_for(parts, 1, [&](size_t begin, size_t end) {
+			for (size_t k = begin; k < end; k++)
+				blocks[k] = impl::parse(part(k), columns, out + starts[k]);
+		});
+		for (size_t k = 0; k < parts; k++) {
+			auto &b = blocks[k];
+			if (b.error_line != impl::none)
+				fail(b.error_line, b.error);
+			std::copy_n(out + starts[k], b.rows * columns, out + filled);
+			filled += b.rows * columns;
+			line += b.lines;
+		}
+	}
+	// fields of the first line that is not blank, 0 when there is none or it
+	// does not parse, parse() reports that
+	static size_t first_columns(std::string_view body) {
+		for (size_t pos = 0; pos < body.size();) {
+			size_t end = std::min(body.find('\n', pos), body.size());
+			auto line = body.substr(pos, end - pos);
+			pos = end + 1;
+			if (!impl::blank(line)) {
+				size_t n = impl::parse_line(line, nullptr, 0);
+				return n == impl::none ? 0 : n;
+			}
+		}
+		return 0;
+	}
+	// room for values, grown at once to what the rest of the file holds at
+	// the density parsed so far when its size is known, doubled otherwise,
+	// and not past the rows the caller wants
+	void reserve(size_t values) {
+		if (values <= pending.size())
+			return;
+		size_t want = std::max(values, 2 * pending.size());
+		if (consumed != 0 && file_bytes > consumed) {
+			size_t rest = size_t(double(file_bytes - consumed) * parsed / consumed);
+			want = values + rest + rest / 32;
+		}
+		if (columns != 0 && wanted < impl::none / columns)
+			want = std::min(want, wanted * columns);
+		aligned_buffer grown(std::max(values, want));
+		std::copy_n(pending.data(), filled, grown.data());
+		pending = std::move(grown);
+	}
+	[[noreturn]] void fail(size_t offset, const std::string &what) {
+		throw std::invalid_argument{path + ":" + std::to_string(line + offset + 1) +
+		                            ": " + what};
+	}
+
+	std::string path;
+	std::unique_ptr<std::FILE, int (*)(std::FILE *)> file;
+	std::string text;       // unparsed tail of the last chunk
+	aligned_buffer pending; // parsed rows not returned yet, filled values
+	size_t filled{};
+	size_t columns{};
+	size_t line{};                             // lines before text
+	size_t wanted{};                           // rows asked for by next()
+	size_t file_bytes{}, consumed{}, parsed{}; // for sizing pending
+	bool started{}; // a line that is not blank was seen
+	bool eof{};
+};
+
+// the whole file as a rows x columns matrix
+inline dense read(const std::string &path) {
+	reader r(path);
+	dense result;
+	if (!r.next(impl::none, result))
+		throw std::invalid_argument{path + " has no rows"};
+	return result;
+}
+} // namespace csv
+} // namespace matlang
+
+#endif /* end of include guard: CSV_HPP */
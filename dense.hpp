@@ -0,0 +1,255 @@
+#ifndef DENSE_HPP
+#define DENSE_HPP
+
+#include "buffer_pool.hpp"
+#include "slice.hpp"
+#include "small_vector.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace matlang {
+// ranks up to 4 keep their shape and strides inline
+using shape_t = small_vector<size_t, 4>;
+
+inline shape_t contiguous_strides(const shape_t &shape) {
+	shape_t strides(shape.size());
+	size_t stride = 1;
+	for (size_t d = shape.size(); d-- > 0;) {
+		strides[d] = stride;
+		stride *= shape[d];
+	}
+	return strides;
+}
+inline size_t shape_count(const shape_t &shape) {
+	return std::accumulate(shape.begin(), shape.end(), size_t{1},
+	                       std::multiplies<size_t>{});
+}
+// the shape a and b both stretch to: trailing axes line up, and a missing axis
+// or one of length 1 takes the length of the other side
+inline shape_t broadcast_shape(const shape_t &a, const shape_t &b) {
+	shape_t result(std::max(a.size(), b.size()));
+	for (size_t k = 1; k <= result.size(); k++) {
+		size_t x = k <= a.size() ? a[a.size() - k] : 1;
+		size_t y = k <= b.size() ? b[b.size() - k] : 1;
+		if (x != y && x != 1 && y != 1)
+			throw std::invalid_argument{"size mismatch"};
+		result[result.size() - k] = x == 1 ? y : x;
+	}
+	return result;
+}
+
+// flat double storage aligned to a cache line
+class aligned_buffer {
+public:
+	constexpr static size_t alignment = buffer_pool::alignment;
+
+	aligned_buffer() = default;
+	explicit aligned_buffer(size_t count)
+	    : count_{count}, data_{allocate(count), deleter{nullptr, count}} {
+		std::fill_n(data_.get(), count_, 0.0);
+	}
+	// adopts external storage kept alive by owner, e.g. a mapped file
+	aligned_buffer(double *data, size_t count, std::shared_ptr<const void> owner)
+	    : count_{count}, data_{data, deleter{std::move(owner), 0}} {}
+	aligned_buffer(const aligned_buffer &o)
+	    : count_{o.count_}, data_{allocate(o.count_), deleter{nullptr, o.count_}} {
+		std::copy_n(o.data_.get(), count_, data_.get());
+	}
+	aligned_buffer(aligned_buffer &&) noexcept = default;
+	aligned_buffer &operator=(const aligned_buffer &o) {
+		if (this != &o)
+			*this = aligned_buffer(o);
+		return *this;
+	}
+	aligned_buffer &operator=(aligned_buffer &&) noexcept = default;
+
+	size_t size() const { return count_; }
+	// elements the block was allocated for, size() for adopted storage
+	size_t capacity() const { return std::max(count_, data_.get_deleter().count); }
+	double *data() { return data_.get(); }
+	const double *data() const { return data_.get(); }
+	// keeps the first count elements, the block is released whole
+	void shrink(size_t count) { count_ = std::min(count, count_); }
+
+private:
+	struct deleter {
+		std::shared_ptr<const void> owner;
+		size_t count;
+		void operator()(double *p) const {
+			if (!owner)
+				buffer_pool::release(p, count * sizeof(double));
+		}
+	};
+	static double *allocate(size_t count) {
+		return static_cast<double *>(buffer_pool::allocate(count * sizeof(double)));
+	}
+
+	size_t count_{};
+	std::unique_ptr<double[], deleter> data_{};
+};
+
+// strided window over dense storage, axis 0 may be gathered through a slice
+// of explicit indices
+struct dense_view {
+	double *data{};
+	shape_t shape{};
+	shape_t strides{};
+	slice rows{};
+
+	size_t size() const { return shape[0]; }
+	size_t rank() const { return shape.size(); }
+	size_t count() const { return shape_count(shape); }
+	bool gathered() const { return !rows.empty(); }
+	bool contiguous() const {
+		return !gathered() && strides == contiguous_strides(shape);
+	}
+	double *row(size_t i) const {
+		return data + (gathered() ? rows[i] : i) * strides[0];
+	}
+	// element i of axis 0 as a view of rank - 1, requires rank > 1
+	dense_view sub(size_t i) const {
+		return {row(i), shape_t(shape.begin() + 1, shape.end()),
+		        shape_t(strides.begin() + 1, strides.end()), {}};
+	}
+	// ranges stay strided windows, explicit lists gather rows
+	dense_view gather(const slice &s) const {
+		if (!s.empty() && s.max() >= size())
+			throw std::invalid_argument{"slice index out of bounds"};
+		dense_view result = *this;
+		result.shape[0] = s.size();
+		if (gathered())
+			result.rows = rows.select(s);
+		else if (!s.is_range())
+			result.rows = s;
+		else {
+			result.data += s.start() * strides[0];
+			result.strides[0] *= s.step();
+		}
+		return result;
+	}
+	// the same elements read as `to`, a broadcast of this shape: added and
+	// stretched axes get stride 0 so nothing is copied; requires !gathered()
+	dense_view stretch(const shape_t &to) const {
+		size_t extra = to.size() - rank();
+		dense_view result{data, to, shape_t(to.size()), {}};
+		for (size_t d = 0; d < rank(); d++)
+			if (shape[d] == to[extra + d])
+				result.strides[extra + d] = strides[d];
+		return result;
+	}
+};
+
+// copies share the buffer until one of them is written through data() or
+// mutable_view()
+class dense {
+public:
+	dense() = default;
+	explicit dense(shape_t shape)
+	    : shape_{std::move(shape)}, strides_{contiguous_strides(shape_)},
+	      buffer_{std::make_shared<aligned_buffer>(shape_count(shape_))} {}
+	dense(shape_t shape, aligned_buffer buffer)
+	    : shape_{std::move(shape)}, strides_{contiguous_strides(shape_)},
+	      buffer_{std::make_shared<aligned_buffer>(std::move(buffer))} {
+		if (buffer_->size() != shape_count(shape_))
+			throw std::invalid_argument{"size mismatch"};
+	}
+	explicit dense(const dense_view &v);
+
+	const shape_t &shape() const { return shape_; }
+	const shape_t &strides() const { return strides_; }
+	size_t size() const { return shape_[0]; }
+	size_t rank() const { return shape_.size(); }
+	size_t count() const { return buffer_ ? buffer_->size() : 0; }
+	size_t capacity() const { return buffer_ ? buffer_->capacity() : 0; }
+	bool shared() const { return buffer_.use_count() > 1; }
+	double *data() {
+		unshare();
+		return buffer_ ? buffer_->data() : nullptr;
+	}
+	const double *data() const { return buffer_ ? buffer_->data() : nullptr; }
+
+	// for reading only
+	dense_view view() const {
+		return {const_cast<double *>(data()), shape_, strides_, {}};
+	}
+	dense_view mutable_view() { return {data(), shape_, strides_, {}}; }
+
+private:
+	void unshare() {
+		if (shared())
+			buffer_ = std::make_shared<aligned_buffer>(*buffer_);
+	}
+
+	shape_t shape_{};
+	shape_t strides_{};
+	std::shared_ptr<aligned_buffer> buffer_{};
+};
+
+// calls fn(n, ptrs, strides) for every innermost run of equally shaped views
+template <size_t N, typename Fn>
+void for_each_run(const std::array<const dense_view *, N> &v, Fn &&fn) {
+	auto &lead = *v[0];
+	if (std::all_of(v.begin(), v.end(),
+	                [](auto *a) { return a->contiguous(); })) {
+		std::array<double *, N> p;
+		std::array<size_t, N> s;
+		for (size_t k = 0; k < N; k++) {
+			p[k] = v[k]->data;
+			s[k] = 1;
+		}
+		fn(lead.count(), p, s);
+		return;
+	}
+	auto walk = [&](auto &self, size_t dim, std::array<double *, N> base) -> void {
+		size_t n = lead.shape[dim];
+		std::array<double *, N> p;
+		if (dim + 1 == lead.rank()) {
+			bool gathered = dim == 0 && std::any_of(v.begin(), v.end(), [](auto *a) {
+				                return a->gathered();
+			                });
+			if (!gathered) {
+				std::array<size_t, N> s;
+				for (size_t k = 0; k < N; k++) {
+					p[k] = dim == 0 ? v[k]->data : base[k];
+					s[k] = v[k]->strides[dim];
+				}
+				fn(n, p, s);
+				return;
+			}
+			std::array<size_t, N> s;
+			s.fill(1);
+			for (size_t i = 0; i < n; i++) {
+				for (size_t k = 0; k < N; k++)
+					p[k] = v[k]->row(i);
+				fn(1, p, s);
+			}
+			return;
+		}
+		for (size_t i = 0; i < n; i++) {
+			for (size_t k = 0; k < N; k++)
+				p[k] = dim == 0 ? v[k]->row(i) : base[k] + i * v[k]->strides[dim];
+			self(self, dim + 1, p);
+		}
+	};
+	walk(walk, 0, {});
+}
+
+inline dense::dense(const dense_view &v) : dense(v.shape) {
+	auto out = mutable_view();
+	for_each_run<2>({&out, &v}, [](size_t n, auto p, auto s) {
+		if (s[1] == 1)
+			return (void)std::copy_n(p[1], n, p[0]);
+		for (size_t j = 0; j < n; j++)
+			p[0][j * s[0]] = p[1][j * s[1]];
+	});
+}
+} // namespace matlang
+
+#endif /* end of include guard: DENSE_HPP */
@@ -0,0 +1,226 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include "dense.hpp"
+#include "kernels.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace matlang {
+// row-major C[m x n] += A[m x k] * B[k x n] with packed, cache-blocked panels
+namespace gemm {
+constexpr size_t mr = 4;   // rows of a register tile
+constexpr size_t nr = 8;   // columns of a register tile
+constexpr size_t mc = 128; // rows of A kept in L2
+constexpr size_t kc = 256; // depth of a packed panel
+constexpr size_t nc = 2048; // columns of B kept in L3
+// work per thread below which splitting does not pay off
+constexpr size_t parallel_flops = size_t{1} << 22;
+
+namespace impl {
+using v4d = double __attribute__((vector_size(32)));
+// 4 doubles at any address; vector types may alias their elements
+using v4d_unaligned = double __attribute__((vector_size(32), aligned(8)));
+
+// vectors pass by reference, by value they would change the ABI with the
+// target and GCC notes it on every build
+inline const v4d_unaligned &load(const double *p) {
+	return *reinterpret_cast<const v4d_unaligned *>(p);
+}
+inline void store(double *p, const v4d &v) {
+	*reinterpret_cast<v4d_unaligned *>(p) = v;
+}
+
+// mr x nr tile of packed a and b accumulated into c
+#define MATLANG_GEMM_MICRO(name, attr)                                          \
+	attr inline void name(size_t k, const double *a, const double *b, double *c, \
+	                      size_t ldc) {                                          \
+		v4d c00{}, c01{}, c10{}, c11{}, c20{}, c21{}, c30{}, c31{};              \
+		for (size_t p = 0; p < k; p++, a += mr, b += nr) {                      \
+			v4d b0 = load(b), b1 = load(b + 4);                                  \
+			c00 += a[0] * b0;                                                    \
+			c01 += a[0] * b1;                                                    \
+			c10 += a[1] * b0;                                                    \
+			c11 += a[1] * b1;                                                    \
+			c20 += a[2] * b0;                                                    \
+			c21 += a[2] * b1;                                                    \
+			c30 += a[3] * b0;                                                    \
+			c31 += a[3] * b1;                                                    \
+		}                                                                        \
+		store(c, load(c) + c00);                                                 \
+		store(c + 4, load(c + 4) + c01);                                         \
+		c += ldc;                                                                \
+		store(c, load(c) + c10);                                                 \
+		store(c + 4, load(c + 4) + c11);                                         \
+		c += ldc;                                                                \
+		store(c, load(c) + c20);                                                 \
+		store(c + 4, load(c + 4) + c21);                                         \
+		c += ldc;                                                                \
+		store(c, load(c) + c30);                                                 \
+		store(c + 4, load(c + 4) + c31);                                         \
+	}
+MATLANG_GEMM_MICRO(micro_generic, )
+#ifdef MATLANG_X86
+MATLANG_GEMM_MICRO(micro_avx2, __attribute__((target("avx2,fma"))))
+#endif
+#undef MATLANG_GEMM_MICRO
+
+using micro_fn = void (*)(size_t, const double *, const double *, double *,
+                          size_t);
+inline micro_fn micro() {
+#ifdef MATLANG_X86
+	static const micro_fn fn = kernels::active().level >= kernels::isa::avx2 &&
+	                                   __builtin_cpu_supports("fma")
+	                               ? micro_avx2
+	                               : micro_generic;
+	return fn;
+#else
+	return micro_generic;
+#endif
+}
+
+// rows of a in mr-row panels, column by column, zero padded
+inline void pack_a(size_t m, size_t k, const double *a, size_t lda,
+                   double *out) {
+	for (size_t i = 0; i < m; i += mr)
+		for (size_t p = 0; p < k; p++)
+			for (size_t r = 0; r < mr; r++)
+				*out++ = i + r < m ? a[(i + r) * lda + p] : 0.0;
+}
+// columns of b in nr-column panels, row by row, zero padded
+inline void pack_b(size_t k, size_t n, const double *b, size_t ldb,
+                   double *out) {
+	for (size_t j = 0; j < n; j += nr)
+		for (size_t p = 0; p < k; p++) {
+			const double *row = b + p * ldb + j;
+			size_t w = std::min(nr, n - j);
+			std::copy_n(row, w, out);
+			std::fill(out + w, out + nr, 0.0);
+			out += nr;
+		}
+}
+
+inline void serial(size_t m, size_t n, size_t k, const double *a, size_t lda,
+                   const double *b, size_t ldb, double *c, size_t ldc) {
+	auto kernel = micro();
+	size_t kb_max = std::min(kc, k), mb_max = std::min(mc, m);
+	size_t nb_max = std::min(nc, n);
+	aligned_buffer a_pack((mb_max + mr - 1) / mr * mr * kb_max);
+	aligned_buffer b_pack((nb_max + nr - 1) / nr * nr * kb_max);
+	double edge[mr * nr];
+	for (size_t jc = 0; jc < n; jc += nc) {
+		size_t nb = std::min(nc, n - jc);
+		for (size_t pc = 0; pc < k; pc += kc) {
+			size_t kb = std::min(kc, k - pc);
+			pack_b(kb, nb, b + pc * ldb + jc, ldb, b_pack.data());
+			for (size_t ic = 0; ic < m; ic += mc) {
+				size_t mb = std::min(mc, m - ic);
+				pack_a(mb, kb, a + ic * lda + pc, lda, a_pack.data());
+				for (size_t jr = 0; jr < nb; jr += nr)
+					for (size_t ir = 0; ir < mb; ir += mr) {
+						const double *ap = a_pack.data() + ir * kb;
+						const double *bp = b_pack.data() + jr * kb;
+						double *cp = c + (ic + ir) * ldc + jc + jr;
+						size_t h = std::min(mr, mb - ir), w = std::min(nr, nb - jr);
+						if (h == mr && w == nr) {
+							kernel(kb, ap, bp, cp, ldc);
+							continue;
+						}
+						std::fill_n(edge, mr * nr, 0.0);
+						kernel(kb, ap, bp, edge, nr);
+						for (size_t r = 0; r < h; r++)
+							for (size_t q = 0; q < w; q++)
+								cp[r * ldc + q] += edge[r * nr + q];
+					}
+			}
+		}
+	}
+}
+
+// dimensions up to small are unrolled at compile time, no packing
+constexpr size_t small = 4;
+inline bool fixed(size_t m, size_t n, size_t k, const double *a, size_t lda,
+                  const double *b, size_t ldb, double *c, size_t ldc) {
+	using kernels::fixed::dispatch;
+	return dispatch<small>(m, [&](auto M) {
+		dispatch<small>(n, [&](auto N) {
+			dispatch<small>(k, [&](auto K) {
+				for (size_t i = 0; i < M; i++)
+					for (size_t j = 0; j < N; j++) {
+						double sum = 0;
+						for (size_t p = 0; p < K; p++)
+							sum += a[i * lda + p] * b[p * ldb + j];
+						c[i * ldc + j] += sum;
+					}
+			});
+		});
+	});
+}
+
+// chunk of rows worth splitting off, at least one per pool thread
+inline size_t rows_per_chunk(size_t m, size_t flops_per_row, size_t step) {
+	size_t rows = parallel_flops / std::max<size_t>(flops_per_row, 1);
+	rows = std::max(rows, (m + pool().size() - 1) / pool().size());
+	return std::max(step, (rows + step - 1) / step * step);
+}
+} // namespace impl
+
+inline void multiply(size_t m, size_t n, size_t k, const double *a, size_t lda,
+                     const double *b, size_t ldb, double *c, size_t ldc) {
+	if (m <= impl::small && n <= impl::small && k <= impl::small &&
+	    impl::fixed(m, n, k, a, lda, b, ldb, c, ldc))
+		return;
+	pool().parallel_for(m, impl::rows_per_chunk(m, n * k, mr),
+	                    [&](size_t begin, size_t end) {
+		                    impl::serial(end - begin, n, k, a + begin * lda, lda, b,
+		                                 ldb, c + begin * ldc, ldc);
+	                    });
+}
+
+// y[m] = A[m x k] * x[k]
+inline void multiply_vector(size_t m, size_t k, const double *a, size_t lda,
+                            const double *x, double *y) {
+	if (m <= impl::small && k <= impl::small) {
+		std::fill_n(y, m, 0.0);
+		if (impl::fixed(m, 1, k, a, lda, x, 1, y, 1))
+			return;
+	}
+	pool().parallel_for(m, impl::rows_per_chunk(m, k, 1), [&](size_t begin,
+	                                                          size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			const double *row = a + i * lda;
+			impl::v4d s0{}, s1{};
+			size_t p = 0;
+			for (; p + 8 <= k; p += 8) {
+				s0 += impl::load(row + p) * impl::load(x + p);
+				s1 += impl::load(row + p + 4) * impl::load(x + p + 4);
+			}
+			s0 += s1;
+			double sum = s0[0] + s0[1] + s0[2] + s0[3];
+			for (; p < k; p++)
+				sum += row[p] * x[p];
+			y[i] = sum;
+		}
+	});
+}
+
+// y[n] = x[k] * B[k x n]
+inline void vector_multiply(size_t k, size_t n, const double *x,
+                            const double *b, size_t ldb, double *y) {
+	if (k <= impl::small && n <= impl::small &&
+	    impl::fixed(1, n, k, x, k, b, ldb, y, n))
+		return;
+	pool().parallel_for(n, impl::rows_per_chunk(n, k, nr), [&](size_t begin,
+	                                                           size_t end) {
+		for (size_t p = 0; p < k; p++) {
+			const double *row = b + p * ldb;
+			for (size_t j = begin; j < end; j++)
+				y[j] += x[p] * row[j];
+		}
+	});
+}
+} // namespace gemm
+} // namespace matlang
+
+#endif /* end of include guard: GEMM_HPP */
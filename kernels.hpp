@@ -0,0 +1,269 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MATLANG_X86 1
+#include <immintrin.h>
+#endif
+
+namespace matlang {
+// elementwise loops over contiguous runs, out may alias a; float32 runs get
+// twice the lanes per vector
+namespace kernels {
+enum class isa { scalar, sse2, avx2, avx512 };
+
+struct table {
+	isa level;
+	void (*add)(double *out, const double *a, const double *b, size_t n);
+	void (*subtract)(double *out, const double *a, const double *b, size_t n);
+	void (*scale)(double *out, const double *a, double f, size_t n);
+	void (*add32)(float *out, const float *a, const float *b, size_t n);
+	void (*subtract32)(float *out, const float *a, const float *b, size_t n);
+	void (*scale32)(float *out, const float *a, float f, size_t n);
+};
+
+namespace impl {
+template <typename T>
+void add_scalar(T *out, const T *a, const T *b, size_t n) {
+	for (size_t j = 0; j < n; j++)
+		out[j] = a[j] + b[j];
+}
+template <typename T>
+void subtract_scalar(T *out, const T *a, const T *b, size_t n) {
+	for (size_t j = 0; j < n; j++)
+		out[j] = a[j] - b[j];
+}
+template <typename T> void scale_scalar(T *out, const T *a, T f, size_t n) {
+	for (size_t j = 0; j < n; j++)
+		out[j] = a[j] * f;
+}
+
+#ifdef MATLANG_X86
+#define MATLANG_BINARY_KERNEL(name, attr, T, width, vec, load, store, op,         \
+                              scalar_op)                                         \
+	attr inline void name(T *out, const T *a, const T *b, size_t n) {            \
+		size_t j = 0;                                                            \
+		for (; j + 2 * width <= n; j += 2 * width) {                             \
+			vec x0 = op(load(a + j), load(b + j));                               \
+			vec x1 = op(load(a + j + width), load(b + j + width));               \
+			store(out + j, x0);                                                  \
+			store(out + j + width, x1);                                          \
+		}                                                                        \
+		for (; j < n; j++)                                                       \
+			out[j] = a[j] scalar_op b[j];                                        \
+	}
+#define MATLANG_SCALE_KERNEL(name, attr, T, width, vec, load, store, mul, set1)  \
+	attr inline void name(T *out, const T *a, T f, size_t n) {                   \
+		vec vf = set1(f);                                                        \
+		size_t j = 0;                                                            \
+		for (; j + 2 * width <= n; j += 2 * width) {                             \
+			vec x0 = mul(load(a + j), vf);                                       \
+			vec x1 = mul(load(a + j + width), vf);                               \
+			store(out + j, x0);                                                  \
+			store(out + j + width, x1);                                          \
+		}                                                                        \
+		for (; j < n; j++)                                                       \
+			out[j] = a[j] * f;                                                   \
+	}
+
+#define MATLANG_SSE2 __attribute__((target("sse2")))
+MATLANG_BINARY_KERNEL(add_sse2, MATLANG_SSE2, double, 2, __m128d, _mm_loadu_pd,
+                      _mm_storeu_pd, _mm_add_pd, +)
+MATLANG_BINARY_KERNEL(subtract_sse2, MATLANG_SSE2, double, 2, __m128d,
+                      _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, -)
+MATLANG_SCALE_KERNEL(scale_sse2, MATLANG_SSE2, double, 2, __m128d, _mm_loadu_pd,
+                     _mm_storeu_pd, _mm_mul_pd, _mm_set1_pd)
+MATLANG_BINARY_KERNEL(add32_sse2, MATLANG_SSE2, float, 4, __m128, _mm_loadu_ps,
+                      _mm_storeu_ps, _mm_add_ps, +)
+MATLANG_BINARY_KERNEL(subtract32_sse2, MATLANG_SSE2, float, 4, __m128,
+                      _mm_loadu_ps, _mm_storeu_ps, _mm_sub_ps, -)
+MATLANG_SCALE_KERNEL(scale32_sse2, MATLANG_SSE2, float, 4, __m128, _mm_loadu_ps,
+                     _mm_storeu_ps, _mm_mul_ps, _mm_set1_ps)
+
+#define MATLANG_AVX2 __attribute__((target("avx2")))
+MATLANG_BINARY_KERNEL(add_avx2, MATLANG_AVX2, double, 4, __m256d,
+                      _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, +)
+MATLANG_BINARY_KERNEL(subtract_avx2, MATLANG_AVX2, double, 4, __m256d,
+                      _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, -)
+MATLANG_SCALE_KERNEL(scale_avx2, MATLANG_AVX2, double, 4, __m256d,
+                     _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd,
+                     _mm256_set1_pd)
+MATLANG_BINARY_KERNEL(add32_avx2, MATLANG_AVX2, float, 8, __m256,
+                      _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, +)
+MATLANG_BINARY_KERNEL(subtract32_avx2, MATLANG_AVX2, float, 8, __m256,
+                      _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sub_ps, -)
+MATLANG_SCALE_KERNEL(scale32_avx2, MATLANG_AVX2, float, 8, __m256,
+                     _mm256_loadu_ps, _mm256_storeu_ps, _mm256_mul_ps,
+                     _mm256_set1_ps)
+
+#define MATLANG_AVX512 __attribute__((target("avx512f")))
+MATLANG_BINARY_KERNEL(add_avx512, MATLANG_AVX512, double, 8, __m512d,
+                      _mm512_loadu_pd, _mm512_storeu_pd, _mm512_add_pd, +)
+MATLANG_BINARY_KERNEL(subtract_avx512, MATLANG_AVX512, double, 8, __m512d,
+                      _mm512_loadu_pd, _mm512_storeu_pd, _mm512_sub_pd, -)
+MATLANG_SCALE_KERNEL(scale_avx512, MATLANG_AVX512, double, 8, __m512d,
+                     _mm512_loadu_pd, _mm512_storeu_pd, _mm512_mul_pd,
+                     _mm512_set1_pd)
+MATLANG_BINARY_KERNEL(add32_avx512, MATLANG_AVX512, float, 16, __m512,
+                      _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, +)
+MATLANG_BINARY_KERNEL(subtract32_avx512, MATLANG_AVX512, float, 16, __m512,
+                      _mm512_loadu_ps, _mm512_storeu_ps, _mm512_sub_ps, -)
+MATLANG_SCALE_KERNEL(scale32_avx512, MATLANG_AVX512, float, 16, __m512,
+                     _mm512_loadu_ps, _mm512_storeu_ps, _mm512_mul_ps,
+                     _mm512_set1_ps)
+
+#undef MATLANG_SSE2
+#undef MATLANG_AVX2
+#undef MATLANG_AVX512
+#undef MATLANG_BINARY_KERNEL
+#undef MATLANG_SCALE_KERNEL
+#endif
+} // namespace impl
+
+// lengths up to max get loops unrolled at compile time instead of a call
+// through the table, small vectors and matrices are the common case
+namespace fixed {
+constexpr size_t max = 16;
+
+// fn(std::integral_constant<size_t, n>) for 0 < n <= Max, false otherwise
+template <size_t Max, typename Fn, size_t... I>
+bool dispatch(size_t n, const Fn &fn, std::index_sequence<I...>) {
+	return ((n == I + 1 && (fn(std::integral_constant<size_t, I + 1>{}), true)) ||
+	        ...);
+}
+template <size_t Max, typename Fn> bool dispatch(size_t n, const Fn &fn) {
+	return dispatch<Max>(n, fn, std::make_index_sequence<Max>{});
+}
+
+inline void add(double *out, const double *a, const double *b, size_t n) {
+	dispatch<max>(n, [&](auto N) {
+		for (size_t j = 0; j < N; j++)
+			out[j] = a[j] + b[j];
+	});
+}
+inline void subtract(double *out, const double *a, const double *b, size_t n) {
+	dispatch<max>(n, [&](auto N) {
+		for (size_t j = 0; j < N; j++)
+			out[j] = a[j] - b[j];
+	});
+}
+inline void scale(double *out, const double *a, double f, size_t n) {
+	dispatch<max>(n, [&](auto N) {
+		for (size_t j = 0; j < N; j++)
+			out[j] = a[j] * f;
+	});
+}
+} // namespace fixed
+
+inline bool supported(isa level) {
+#ifdef MATLANG_X86
+	switch (level) {
+	case isa::avx512:
+		return __builtin_cpu_supports("avx512f");
+	case isa::avx2:
+		return __builtin_cpu_supports("avx2");
+	default:
+		return true;
+	}
+#else
+	return level == isa::scalar;
+#endif
+}
+
+inline table select(isa level) {
+#ifdef MATLANG_X86
+	switch (level) {
+	case isa::avx512:
+		return {level,
+		        impl::add_avx512,
+		        impl::subtract_avx512,
+		        impl::scale_avx512,
+		        impl::add32_avx512,
+		        impl::subtract32_avx512,
+		        impl::scale32_avx512};
+	case isa::avx2:
+		return {level,
+		        impl::add_avx2,
+		        impl::subtract_avx2,
+		        impl::scale_avx2,
+		        impl::add32_avx2,
+		        impl::subtract32_avx2,
+		        impl::scale32_avx2};
+	case isa::sse2:
+		return {level,
+		        impl::add_sse2,
+		        impl::subtract_sse2,
+		        impl::scale_sse2,
+		        impl::add32_sse2,
+		        impl::subtract32_sse2,
+		        impl::scale32_sse2};
+	default:
+		break;
+	}
+#endif
+	return {isa::scalar,
+	        impl::add_scalar<double>,
+	        impl::subtract_scalar<double>,
+	        impl::scale_scalar<double>,
+	        impl::add_scalar<float>,
+	        impl::subtract_scalar<float>,
+	        impl::scale_scalar<float>};
+}
+
+// best supported level, MATLANG_ISA=scalar|sse2|avx2|avx512 caps it
+inline isa detect() {
+	isa cap = isa::avx512;
+	if (const char *env = std::getenv("MATLANG_ISA")) {
+		if (!std::strcmp(env, "scalar"))
+			cap = isa::scalar;
+		else if (!std::strcmp(env, "sse2"))
+			cap = isa::sse2;
+		else if (!std::strcmp(env, "avx2"))
+			cap = isa::avx2;
+	}
+	for (isa level : {isa::avx512, isa::avx2, isa::sse2})
+		if (level <= cap && supported(level))
+			return level;
+	return isa::scalar;
+}
+
+inline const table &active() {
+	static const table t = select(detect());
+	return t;
+}
+
+inline void add(double *out, const double *a, const double *b, size_t n) {
+	if (n <= fixed::max)
+		return fixed::add(out, a, b, n);
+	active().add(out, a, b, n);
+}
+inline void subtract(double *out, const double *a, const double *b, size_t n) {
+	if (n <= fixed::max)
+		return fixed::subtract(out, a, b, n);
+	active().subtract(out, a, b, n);
+}
+inline void scale(double *out, const double *a, double f, size_t n) {
+	if (n <= fixed::max)
+		return fixed::scale(out, a, f, n);
+	active().scale(out, a, f, n);
+}
+inline void add(float *out, const float *a, const float *b, size_t n) {
+	active().add32(out, a, b, n);
+}
+inline void subtract(float *out, const float *a, const float *b, size_t n) {
+	active().subtract32(out, a, b, n);
+}
+inline void scale(float *out, const float *a, float f, size_t n) {
+	active().scale32(out, a, f, n);
+}
+} // namespace kernels
+} // namespace matlang
+
+#endif /* end of include guard: KERNELS_HPP */
@@ -0,0 +1,139 @@
+#ifndef LAZY_HPP
+#define LAZY_HPP
+
+#include "kernels.hpp"
+#include "object.hpp"
+#include "thread_pool.hpp"
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+
+namespace matlang {
+// elementwise expression over dense operands, evaluated in a single pass
+class lazy {
+public:
+	constexpr static size_t block_size = 256;
+
+	// borrows the viewed storage, it must outlive the expression
+	static lazy ref(const dense_view &v) {
+		lazy result(kind::leaf, v.shape);
+		result.leaf = v;
+		return result;
+	}
+	static lazy hold(object o) {
+		auto owned = std::make_shared<const object>(std::move(o));
+		auto result = ref(owned->packed_data().view());
+		result.owned = std::move(owned);
+		return result;
+	}
+
+	const shape_t &shape() const { return shape_; }
+
+	object eval() const {
+		dense result(shape_);
+		double *out = result.data();
+		// grain is a multiple of block_size, so blocks never straddle chunks
+		pool().parallel_for(result.count(), thread_pool::grain, [&](size_t first,
+		                                                            size_t last) {
+			for (size_t begin = first; begin < last; begin += block_size) {
+				size_t n = std::min(block_size, last - begin);
+				const double *p = block(begin, n, out + begin);
+				if (p != out + begin)
+					std::copy_n(p, n, out + begin);
+			}
+		});
+		return object(std::move(result));
+	}
+
+	friend lazy operator+(lazy l, lazy r) {
+		return combine(kind::add, std::move(l), std::move(r));
+	}
+	friend lazy operator-(lazy l, lazy r) {
+		return combine(kind::subtract, std::move(l), std::move(r));
+	}
+	friend lazy operator-(lazy l) {
+		lazy result(kind::negate, l.shape_);
+		result.l = std::make_shared<const lazy>(std::move(l));
+		return result;
+	}
+	friend lazy operator*(lazy l, double r) {
+		lazy result(kind::scale, l.shape_);
+		result.factor = r;
+		result.l = std::make_shared<const lazy>(std::move(l));
+		return result;
+	}
+	friend lazy operator*(double l, lazy r) { return std::move(r) * l; }
+	friend std::ostream &operator<<(std::ostream &os, const lazy &l) {
+		return os << l.eval();
+	}
+
+private:
+	enum class kind : unsigned char { leaf, add, subtract, negate, scale };
+
+	lazy(kind k, shape_t s) : k{k}, shape_{std::move(s)} {}
+
+	static lazy combine(kind k, lazy l, lazy r) {
+		if (l.shape_ != r.shape_)
+			throw std::invalid_argument{"size mismatch"};
+		lazy result(k, l.shape_);
+		result.l = std::make_shared<const lazy>(std::move(l));
+		result.r = std::make_shared<const lazy>(std::move(r));
+		return result;
+	}
+
+	// elements [begin, begin + n) in row-major order, either out or leaf data
+	const double *block(size_t begin, size_t n, double *out) const {
+		switch (k) {
+		case kind::leaf:
+			if (leaf.contiguous())
+				return leaf.data + begin;
+			gather(begin, n, out);
+			return out;
+		case kind::negate:
+		case kind::scale: {
+			const double *a = l->block(begin, n, out);
+			kernels::scale(out, a, k == kind::negate ? -1.0 : factor, n);
+			return out;
+		}
+		default: {
+			double scratch[block_size];
+			const double *a = l->block(begin, n, out);
+			const double *b = r->block(begin, n, scratch);
+			if (k == kind::add)
+				kernels::add(out, a, b, n);
+			else
+				kernels::subtract(out, a, b, n);
+			return out;
+		}
+		}
+	}
+	void gather(size_t begin, size_t n, double *out) const {
+		size_t rank = leaf.rank();
+		shape_t index(rank);
+		for (size_t d = rank, rest = begin; d-- > 0;) {
+			index[d] = rest % leaf.shape[d];
+			rest /= leaf.shape[d];
+		}
+		for (size_t j = 0; j < n; j++) {
+			const double *p = leaf.row(index[0]);
+			for (size_t d = 1; d < rank; d++)
+				p += index[d] * leaf.strides[d];
+			out[j] = *p;
+			for (size_t d = rank; d-- > 0;) {
+				if (++index[d] < leaf.shape[d])
+					break;
+				index[d] = 0;
+			}
+		}
+	}
+
+	kind k;
+	shape_t shape_;
+	dense_view leaf{};
+	double factor{1.0};
+	std::shared_ptr<const object> owned{};
+	std::shared_ptr<const lazy> l{}, r{};
+};
+} // namespace matlang
+
+#endif /* end of include guard: LAZY_HPP */
@@ -0,0 +1,100 @@
+#ifndef LEXER_HPP
+#define LEXER_HPP
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+namespace matlang {
+// tokens as views into the source line, independent of the locale
+namespace lexer {
+enum class kind : unsigned char {
+	end,        // end of the line
+	identifier, // [A-Za-z_][A-Za-z0-9_]*
+	number,     // -?(0|[1-9][0-9]*)(.[0-9]*)?([eE][+-]?[0-9]+)?
+	string,     // "..." without escapes, text excludes the quotes
+	symbol,     // any other single character
+	invalid,    // unterminated string
+};
+
+struct token {
+	kind k;
+	std::string_view text;
+	size_t pos;   // offset of the first character
+	size_t end;   // offset past the last character
+};
+
+constexpr bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+	       c == '\f';
+}
+constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+constexpr bool is_alpha(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+constexpr bool is_alnum(char c) { return is_alpha(c) || is_digit(c); }
+
+inline size_t skip_space(std::string_view s, size_t i) {
+	while (i < s.size() && is_space(s[i]))
+		i++;
+	return i;
+}
+inline size_t scan_digits(std::string_view s, size_t i) {
+	while (i < s.size() && is_digit(s[i]))
+		i++;
+	return i;
+}
+// end of the number starting at i, i itself when there is none
+inline size_t scan_number(std::string_view s, size_t i) {
+	size_t j = i;
+	if (j < s.size() && s[j] == '-')
+		j++;
+	if (j >= s.size() || !is_digit(s[j]))
+		return i;
+	j = s[j] == '0' ? j + 1 : scan_digits(s, j);
+	if (j < s.size() && s[j] == '.')
+		j = scan_digits(s, j + 1);
+	if (j < s.size() && (s[j] == 'e' || s[j] == 'E')) {
+		size_t k = j + 1;
+		if (k < s.size() && (s[k] == '+' || s[k] == '-'))
+			k++;
+		if (k < s.size() && is_digit(s[k]))
+			j = scan_digits(s, k);
+	}
+	return j;
+}
+
+// token starting exactly at i
+inline token next(std::string_view s, size_t i) {
+	if (i >= s.size())
+		return {kind::end, {}, i, i};
+	size_t j = i;
+	if (is_alpha(s[i])) {
+		while (j < s.size() && is_alnum(s[j]))
+			j++;
+		return {kind::identifier, s.substr(i, j - i), i, j};
+	}
+	if ((j = scan_number(s, i)) != i)
+		return {kind::number, s.substr(i, j - i), i, j};
+	if (s[i] == '"') {
+		j = s.find('"', i + 1);
+		if (j == std::string_view::npos)
+			return {kind::invalid, s.substr(i), i, s.size()};
+		return {kind::string, s.substr(i + 1, j - i - 1), i, j + 1};
+	}
+	return {kind::symbol, s.substr(i, 1), i, i + 1};
+}
+
+// false when the text does not fit the type
+inline bool to_double(std::string_view text, double &result) {
+	auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+	return ec == std::errc{} && end == text.data() + text.size();
+}
+inline bool to_index(std::string_view text, size_t &result) {
+	auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+	return ec == std::errc{} && end == text.data() + text.size();
+}
+} // namespace lexer
+} // namespace matlang
+
+#endif /* end of include guard: LEXER_HPP */
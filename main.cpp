@@ -1,8 +1,51 @@
 #include "parser.hpp"
+#include "server.hpp"
+#include <fstream>
 
 using namespace std;
 
-int main() {
+// matlang                      statements from stdin
+// matlang --script file        statements of a file, independent ones run
+//                              concurrently; results and errors in order
+// matlang --serve socket [ws]  sessions over a unix socket, sharing the
+//                              variables of the given workspace files
+int main(int argc, char **argv) {
+	if (argc == 3 && string(argv[1]) == "--script") {
+		ifstream is(argv[2]);
+		if (!is) {
+			cerr << "cannot open " << argv[2] << endl;
+			return 1;
+		}
+		vector<string> lines;
+		for (string line; getline(is, line);)
+			if (line.find_first_not_of(" \t\r") != string::npos)
+				lines.push_back(line);
+		matlang::parser prsr;
+		int status = 0;
+		for (auto &out : prsr.run_script(lines))
+			if (out.compare(0, 7, "error: ") == 0) {
+				cerr << out.substr(7) << endl;
+				status = 1;
+			} else
+				cout << out << endl;
+		return status;
+	}
+	if (argc > 1 && string(argv[1]) == "--serve") {
+		if (argc < 3) {
+			cerr << "usage: " << argv[0] << " --serve socket [workspace...]" << endl;
+			return 2;
+		}
+		try {
+			matlang::server::variables shared;
+			for (int i = 3; i < argc; i++)
+				for (auto &v : matlang::workspace::load(argv[i]))
+					shared.push_back(std::move(v));
+			matlang::server::serve(argv[2], std::move(shared));
+		} catch (std::exception &e) {
+			cerr << e.what() << endl;
+			return 1;
+		}
+	}
 	matlang::parser prsr;
 	string str;
 	while (cout << "> ", getline(cin, str)) {
@@ -11,7 +54,6 @@ int main() {
 			if (prsr.eval(0, str, result) != str.size())
 				throw matlang::parse_error(str.size(), "unhandled error");
 			cout << result << endl;
-			prsr.clear();
 		} catch (std::bad_variant_access &) {
 			cerr << "Type mismatch" << endl;
 		} catch (matlang::parse_error &e) {
@@ -1,25 +1,50 @@
 #ifndef OBJECT_HPP
 #define OBJECT_HPP
 
+#include "dense.hpp"
 #include "slice.hpp"
+#include "sparse.hpp"
+#include "typed.hpp"
 #include <algorithm>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
 namespace matlang {
+class object_view;
 class object {
 public:
 	using flat_impl = double;
-	using container_impl = std::vector<object>;
-	using impl = std::variant<flat_impl, container_impl>;
+	using container_impl = counted_vector<object>;
+	using dense_impl = dense;
+	using sparse_impl = matlang::sparse;
+	using typed_impl = typed_dense;
+	using impl = std::variant<flat_impl, container_impl, dense_impl, sparse_impl,
+	                          typed_impl>;
 
 	object() = default;
 	explicit object(flat_impl data) : storage{std::move(data)} {};
-	explicit object(container_impl data) : storage{std::move(data)} {};
-	object(std::initializer_list<object> data) : storage{std::move(data)} {};
+	explicit object(container_impl data) : storage{pack(std::move(data))} {};
+	explicit object(dense_impl data) : storage{std::move(data)} {};
+	explicit object(sparse_impl data) : storage{std::move(data)} {};
+	explicit object(typed_impl data) : storage{std::move(data)} {};
+	object(std::initializer_list<object> data)
+	    : storage{pack(container_impl(data))} {};
 
 	bool flat() const { return std::holds_alternative<flat_impl>(storage); }
-	size_t size() const { return std::get<container_impl>(storage).size(); }
+	bool packed() const { return std::holds_alternative<dense_impl>(storage); }
+	bool sparse() const { return std::holds_alternative<sparse_impl>(storage); }
+	bool typed() const { return std::holds_alternative<typed_impl>(storage); }
+	size_t size() const {
+		if (packed())
+			return std::get<dense_impl>(storage).size();
+		if (sparse())
+			return std::get<sparse_impl>(storage).size();
+		if (typed())
+			return std::get<typed_impl>(storage).size();
+		return std::get<container_impl>(storage).size();
+	}
 	template <typename Fn> decltype(auto) visit(const Fn &f) {
 		return std::visit(f, storage);
 	}
@@ -27,11 +52,29 @@ public:
 		return std::visit(f, storage);
 	}
 
+	flat_impl value() const { return std::get<flat_impl>(storage); }
+	dense_impl &packed_data() { return std::get<dense_impl>(storage); }
+	const dense_impl &packed_data() const { return std::get<dense_impl>(storage); }
+	sparse_impl &sparse_data() { return std::get<sparse_impl>(storage); }
+	const sparse_impl &sparse_data() const { return std::get<sparse_impl>(storage); }
+	typed_impl &typed_data() { return std::get<typed_impl>(storage); }
+	const typed_impl &typed_data() const { return std::get<typed_impl>(storage); }
+
 	auto &operator[](size_t id) { return std::get<container_impl>(storage)[id]; }
-	auto operator[](slice s);
-	auto view();
+	// elements down to the innermost containers
+	size_t elements() const;
+	// bytes of storage as allocated: pool blocks rounded to their class and
+	// every slot of nested containers, storage shared with copies in full
+	size_t footprint() const;
+	// views for writing, shared dense storage is copied first
+	object_view operator[](slice s);
+	object_view view();
+	// falls back to the nested representation, rows stay dense
+	void unpack();
 
 private:
+	static impl pack(container_impl data);
+
 	impl storage{0.0};
 };
 
@@ -39,39 +82,124 @@ class object_view {
 public:
 	using flat_impl = object::flat_impl;
 	using container_impl = slice_array<object::container_impl>;
-	using impl = container_impl;
+	using dense_impl = dense_view;
+	using impl = std::variant<container_impl, dense_impl>;
 
 	object_view() = default;
-	object_view(object::container_impl &o, slice s) : storage{o, std::move(s)} {};
+	object_view(object::container_impl &o, slice s)
+	    : storage{container_impl{o, std::move(s)}} {};
+	explicit object_view(dense_impl v) : storage{std::move(v)} {};
 
 	bool flat() const { return false; }
-	size_t size() const { return storage.size(); }
-	template <typename Fn> decltype(auto) visit(const Fn &f) { return f(storage); }
+	bool packed() const { return std::holds_alternative<dense_impl>(storage); }
+	size_t size() const {
+		return std::visit([](auto &a) { return a.size(); }, storage);
+	}
+	template <typename Fn> decltype(auto) visit(const Fn &f) {
+		return std::visit(f, storage);
+	}
 	template <typename Fn> decltype(auto) visit(const Fn &f) const {
-		return f(storage);
+		return std::visit(f, storage);
 	}
 
+	dense_impl &packed_data() { return std::get<dense_impl>(storage); }
+	const dense_impl &packed_data() const { return std::get<dense_impl>(storage); }
+
 	object copy() const {
+		if (packed())
+			return object(dense(std::get<dense_impl>(storage)));
 		object::container_impl result;
-		for (auto &a : storage)
+		for (auto &a : std::get<container_impl>(storage))
 			result.push_back(a);
 		return object(result);
 	}
 
-	auto &operator[](size_t id) { return storage[id]; }
+	auto &operator[](size_t id) { return std::get<container_impl>(storage)[id]; }
 
 private:
 	impl storage{};
 };
-auto object::operator[](slice s) {
-	return object_view(std::get<container_impl>(storage), move(s));
+inline object_view object::operator[](slice s) {
+	if (packed())
+		return object_view(packed_data().mutable_view().gather(s));
+	return object_view(std::get<container_impl>(storage), std::move(s));
+}
+inline object_view object::view() {
+	if (packed())
+		return object_view(packed_data().mutable_view());
+	return (*this)[slice::range(0, size())];
+}
+inline object::container_impl unpack(const dense_view &v) {
+	object::container_impl result;
+	result.reserve(v.size());
+	for (size_t i = 0; i != v.size(); i++)
+		if (v.rank() == 1)
+			result.emplace_back(*v.row(i));
+		else
+			result.emplace_back(dense(v.sub(i)));
+	return result;
+}
+inline size_t object::elements() const {
+	return visit([](auto &a) -> size_t {
+		using T = std::decay_t<decltype(a)>;
+		if constexpr (std::is_same_v<T, flat_impl>)
+			return 1;
+		else if constexpr (std::is_same_v<T, container_impl>) {
+			size_t n = 0;
+			for (auto &b : a)
+				n += b.elements();
+			return n;
+		} else
+			return shape_count(a.shape());
+	});
+}
+inline size_t object::footprint() const {
+	return visit([](auto &a) -> size_t {
+		using T = std::decay_t<decltype(a)>;
+		if constexpr (std::is_same_v<T, flat_impl>)
+			return 0;
+		else if constexpr (std::is_same_v<T, container_impl>) {
+			size_t bytes = a.capacity() * sizeof(object);
+			for (auto &b : a)
+				bytes += b.footprint();
+			return bytes;
+		} else if constexpr (std::is_same_v<T, dense_impl>)
+			return buffer_pool::rounded(a.capacity() * sizeof(double));
+		else if constexpr (std::is_same_v<T, sparse_impl>)
+			return (a.offsets().capacity() + a.indices().capacity()) * sizeof(size_t) +
+			       a.values().capacity() * sizeof(double);
+		else
+			return buffer_pool::rounded(a.bytes_count());
+	});
+}
+inline void object::unpack() {
+	if (packed())
+		storage = matlang::unpack(packed_data().view());
 }
-auto object::view() {
-	slice sl;
-	for (size_t i = 0; i != size(); i++) {
-		sl.push_back(i);
+inline object::impl object::pack(container_impl data) {
+	if (data.empty())
+		return data;
+	shape_t shape{data.size()};
+	if (std::all_of(data.begin(), data.end(), [](auto &a) { return a.flat(); })) {
+		dense result(shape);
+		for (size_t i = 0; i != data.size(); i++)
+			result.data()[i] = std::get<flat_impl>(data[i].storage);
+		return result;
 	}
-	return (*this)[sl];
+	if (!data[0].packed())
+		return data;
+	auto &inner = std::get<dense_impl>(data[0].storage).shape();
+	if (!std::all_of(data.begin(), data.end(), [&](auto &a) {
+		    return a.packed() && std::get<dense_impl>(a.storage).shape() == inner;
+	    }))
+		return data;
+	shape.insert(shape.end(), inner.begin(), inner.end());
+	dense result(shape);
+	size_t step = shape_count(inner);
+	for (size_t i = 0; i != data.size(); i++)
+		std::copy_n(std::as_const(std::get<dense_impl>(data[i].storage)).data(), step,
+		            result.data() + i * step);
+	return result;
 }
 } // namespace matlang
 
@@ -1,7 +1,10 @@
 #ifndef OBJECT_OPS_HPP
 #define OBJECT_OPS_HPP
 
+#include "gemm.hpp"
+#include "kernels.hpp"
 #include "object.hpp"
+#include "thread_pool.hpp"
 #include <cassert>
 #include <ostream>
 #include <stdexcept>
@@ -18,6 +21,17 @@ struct is_container<
 };
 template <typename T> constexpr bool is_container_v = is_container<T>::value;
 
+template <typename T>
+constexpr bool is_dense_v =
+    std::is_same_v<T, dense> || std::is_same_v<T, dense_view>;
+
+template <typename T> constexpr bool is_flat_v = std::is_arithmetic_v<T>;
+
+template <typename T> constexpr bool is_sparse_v = std::is_same_v<T, sparse>;
+
+template <typename T>
+constexpr bool is_typed_v = std::is_same_v<T, typed_dense>;
+
 template <typename T, typename = void> struct is_object {
 	constexpr static bool value = false;
 };
@@ -27,8 +41,180 @@ struct is_object<T,
 	constexpr static bool value = true;
 };
 template <typename T> constexpr bool is_object_v = is_object<T>::value;
+
+template <typename T, typename U>
+constexpr bool is_plain_v = !is_object_v<T> && !is_object_v<U>;
+
+// a sparse operand next to a nested one, never combined
+template <typename T, typename U>
+constexpr bool is_ragged_sparse_v = (is_sparse_v<T> && is_container_v<U>) ||
+                                    (is_container_v<T> && is_sparse_v<U>);
+
+// a typed operand next to another kind of array, computed in float64
+template <typename T, typename U>
+constexpr bool is_widened_v = is_typed_v<T> != is_typed_v<U> && !is_flat_v<T> &&
+                              !is_flat_v<U>;
 } // namespace sfinae
 
+namespace ops_impl {
+// long unit stride runs are split across the pool
+template <typename Fn> void split_run(size_t n, const Fn &fn) {
+	pool().parallel_for(n, thread_pool::grain, fn);
+}
+// a run against one repeated element goes to the binary kernels too, the
+// element spread over a block that stays in cache
+constexpr size_t spread_block = 256;
+template <typename Fn> void spread(size_t n, double v, const Fn &fn) {
+	split_run(n, [&](size_t begin, size_t end) {
+		double block[spread_block];
+		std::fill_n(block, spread_block, v);
+		for (size_t b = begin; b < end; b += spread_block)
+			fn(b, block, std::min(spread_block, end - b));
+	});
+}
+// elementwise loops over equally shaped views, unit strides go to kernels;
+// stride 0 is a broadcast operand
+inline void add_into(const dense_view &out, const dense_view &a,
+                     const dense_view &b) {
+	for_each_run<3>({&out, &a, &b}, [](size_t n, auto p, auto s) {
+		if (s[0] == 1 && s[1] == 1 && s[2] == 1)
+			return split_run(n, [&](size_t b, size_t e) {
+				kernels::add(p[0] + b, p[1] + b, p[2] + b, e - b);
+			});
+		if (s[0] == 1 && s[1] == 1 && s[2] == 0)
+			return spread(n, *p[2], [&](size_t b, const double *v, size_t m) {
+				kernels::add(p[0] + b, p[1] + b, v, m);
+			});
+		if (s[0] == 1 && s[1] == 0 && s[2] == 1)
+			return spread(n, *p[1], [&](size_t b, const double *v, size_t m) {
+				kernels::add(p[0] + b, v, p[2] + b, m);
+			});
+		for (size_t j = 0; j < n; j++)
+			p[0][j * s[0]] = p[1][j * s[1]] + p[2][j * s[2]];
+	});
+}
+inline void subtract_into(const dense_view &out, const dense_view &a,
+                          const dense_view &b) {
+	for_each_run<3>({&out, &a, &b}, [](size_t n, auto p, auto s) {
+		if (s[0] == 1 && s[1] == 1 && s[2] == 1)
+			return split_run(n, [&](size_t b, size_t e) {
+				kernels::subtract(p[0] + b, p[1] + b, p[2] + b, e - b);
+			});
+		if (s[0] == 1 && s[1] == 1 && s[2] == 0)
+			return spread(n, *p[2], [&](size_t b, const double *v, size_t m) {
+				kernels::subtract(p[0] + b, p[1] + b, v, m);
+			});
+		if (s[0] == 1 && s[1] == 0 && s[2] == 1)
+			return spread(n, *p[1], [&](size_t b, const double *v, size_t m) {
+				kernels::subtract(p[0] + b, v, p[2] + b, m);
+			});
+		for (size_t j = 0; j < n; j++)
+			p[0][j * s[0]] = p[1][j * s[1]] - p[2][j * s[2]];
+	});
+}
+inline void scale_into(const dense_view &out, const dense_view &a, double f) {
+	for_each_run<2>({&out, &a}, [&](size_t n, auto p, auto s) {
+		if (s[0] == 1 && s[1] == 1)
+			return split_run(n, [&](size_t b, size_t e) {
+				kernels::scale(p[0] + b, p[1] + b, f, e - b);
+			});
+		for (size_t j = 0; j < n; j++)
+			p[0][j * s[0]] = p[1][j * s[1]] * f;
+	});
+}
+inline void copy_into(const dense_view &out, const dense_view &a) {
+	for_each_run<2>({&out, &a}, [](size_t n, auto p, auto s) {
+		if (s[0] == 1 && s[1] == 1)
+			return split_run(n, [&](size_t b, size_t e) {
+				std::copy(p[1] + b, p[1] + e, p[0] + b);
+			});
+		for (size_t j = 0; j < n; j++)
+			p[0][j * s[0]] = p[1][j * s[1]];
+	});
+}
+inline dense_view view_of(const dense &d) { return d.view(); }
+inline dense_view view_of(dense &d) { return d.mutable_view(); }
+inline const dense_view &view_of(const dense_view &v) { return v; }
+// rank 0 view of a single element, for reading only
+inline dense_view scalar_view(const double &v) {
+	return {const_cast<double *>(&v), {}, {}, {}};
+}
+
+// v read as shape, gathered views are copied first as their rows cannot
+// move to another axis
+inline dense_view stretched(const dense_view &v, const shape_t &shape,
+                            dense &copy) {
+	if (v.shape == shape)
+		return v;
+	if (v.gathered()) {
+		copy = dense(v);
+		return copy.view().stretch(shape);
+	}
+	return v.stretch(shape);
+}
+// v as a single run of n elements, when its elements are contiguous or all
+// the same one
+inline bool as_run(const dense_view &v, size_t n, dense_view &run) {
+	bool repeated = !v.gathered() && std::all_of(v.strides.begin(), v.strides.end(),
+	                                             [](size_t s) { return s == 0; });
+	if (!repeated && !v.contiguous())
+		return false;
+	run = {v.data, {n}, {repeated ? size_t{0} : size_t{1}}, {}};
+	return true;
+}
+// into(out, a, b) with a and b stretched to the shape of out, which is their
+// broadcast; nothing is expanded, and rows of out are split across the pool
+// when the operands do not reduce to single runs
+template <typename Into>
+void broadcast_into(const dense_view &out, const dense_view &a,
+                    const dense_view &b, const Into &into) {
+	if (broadcast_shape(a.shape, b.shape) != out.shape)
+		throw std::invalid_argument{"size mismatch"};
+	dense copy_a, copy_b;
+	auto x = stretched(a, out.shape, copy_a);
+	auto y = stretched(b, out.shape, copy_b);
+	size_t n = out.count();
+	dense_view rx, ry, ro;
+	if (as_run(out, n, ro) && as_run(x, n, rx) && as_run(y, n, ry))
+		return into(ro, rx, ry);
+	if (out.rank() < 2 || n == 0)
+		return into(out, x, y);
+	size_t rows = thread_pool::grain / (n / out.size());
+	pool().parallel_for(out.size(), rows, [&](size_t begin, size_t end) {
+		auto part = slice::range(begin, end - begin);
+		into(out.gather(part), x.gather(part), y.gather(part));
+	});
+}
+template <typename Into>
+dense broadcast(const dense_view &a, const dense_view &b, const Into &into) {
+	dense result(broadcast_shape(a.shape, b.shape));
+	broadcast_into(result.view(), a, b, into);
+	return result;
+}
+template <typename T> dense pack_dense(const T &r) {
+	object packed(object::container_impl(r.begin(), r.end()));
+	if (!packed.packed())
+		throw std::invalid_argument{"size mismatch"};
+	return packed.visit([](auto &a) -> dense {
+		if constexpr (sfinae::is_dense_v<std::decay_t<decltype(a)>>)
+			return a;
+		else
+			return {};
+	});
+}
+[[noreturn]] inline void unsupported_sparse() {
+	throw std::invalid_argument{"unsupported sparse operation"};
+}
+inline dense widened(const typed_dense &a) { return a.widen(); }
+template <typename T> const T &widened(const T &a) { return a; }
+// float64 results go back to the element type of the left side
+inline typed_dense narrowed(const object &o, dtype type) {
+	if (!o.packed())
+		throw std::invalid_argument{"size mismatch"};
+	return typed_dense::from(o.packed_data().view(), type);
+}
+} // namespace ops_impl
+
 //+=
 namespace ops_impl {
 template <typename T, typename U>
@@ -43,29 +229,107 @@ operator+=(T &l, const U &r) {
 	return l;
 }
 template <typename T, typename U>
-std::enable_if_t<sfinae::is_container_v<T> != sfinae::is_container_v<U> &&
-                     !sfinae::is_object_v<T> && !sfinae::is_object_v<U>,
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_dense_v<U>, T> &
+operator+=(T &l, const U &r) {
+	auto lv = view_of(l);
+	const auto &rv = view_of(r);
+	if (lv.shape != rv.shape)
+		broadcast_into(lv, lv, rv, add_into);
+	else
+		add_into(lv, lv, rv);
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_dense_v<U>, T> &
+operator+=(T &l, const U &r) {
+	return l += unpack(view_of(r));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_container_v<U>, T> &
+operator+=(T &l, const U &r) {
+	return l += pack_dense(r);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_sparse_v<U>, T> &
+operator+=(T &l, const U &r) {
+	l = sparse_ops::combine(l, r, 1);
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_sparse_v<U>, T> &
+operator+=(T &l, const U &r) {
+	sparse_ops::add_into(view_of(l), r, 1);
+	return l;
+}
+// scalars stretch over the elements of the left side
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_flat_v<U>, T> &
+operator+=(T &l, const U &r) {
+	for (auto &a : l)
+		a += r;
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_flat_v<U>, T> &
+operator+=(T &l, const U &r) {
+	auto lv = view_of(l);
+	broadcast_into(lv, lv, scalar_view(r), add_into);
+	return l;
+}
+// a sparse left side would have to turn dense
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_ragged_sparse_v<T, U> ||
+                     (sfinae::is_sparse_v<T> &&
+                      (sfinae::is_dense_v<U> || sfinae::is_flat_v<U>)),
                  T> &
+operator+=(T &, const U &) {
+	unsupported_sparse();
+}
+// typed left sides keep their element type
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && !sfinae::is_object_v<U>, T> &
+operator+=(T &l, const U &r) {
+	if constexpr (sfinae::is_flat_v<U>)
+		if (l.type() == dtype::int64 && typed_ops::keeps_type(l, r))
+			return l = typed_ops::shift(l, r, false);
+	if constexpr (sfinae::is_typed_v<U>)
+		if (l.type() == r.type())
+			return l = typed_ops::combine(l, r, false);
+	auto result = l.widen();
+	result += widened(r);
+	return l = typed_dense::from(result.view(), l.type());
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_widened_v<T, U> && !sfinae::is_typed_v<T>, T> &
 operator+=(T &l, const U &r) {
+	return l += r.widen();
+}
+// a scalar left side cannot take the shape of the right one
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && !sfinae::is_flat_v<U> &&
+                     sfinae::is_plain_v<T, U>,
+                 T> &
+operator+=(T &, const U &) {
 	throw std::invalid_argument{"size mismatch"};
 }
+} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U>, T> &
 operator+=(T &l, const U &r) {
+	using ops_impl::operator+=;
 	l.visit([&](auto &underlaying) { underlaying += r; });
 	return l;
 }
 template <typename T, typename U>
 std::enable_if_t<!sfinae::is_object_v<T> && sfinae::is_object_v<U>, T> &
 operator+=(T &l, const U &r) {
+	using ops_impl::operator+=;
 	r.visit([&](auto &underlaying) { l += underlaying; });
 	return l;
 }
-} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>, T> &
 operator+=(T &l, const U &r) {
-	using ops_impl::operator+=;
 	r.visit([&](auto &underlaying) { l += underlaying; });
 	return l;
 }
@@ -73,34 +337,139 @@ operator+=(T &l, const U &r) {
 //+
 namespace ops_impl {
 template <typename T, typename U>
-std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_container_v<U>, object>
+std::enable_if_t<sfinae::is_container_v<T> &&
+                     (sfinae::is_container_v<U> || sfinae::is_dense_v<U>),
+                 object>
 operator+(const T &l, const U &r) {
 	object::container_impl result(l.begin(), l.end());
 	result += r;
 	return object(result);
 }
 template <typename T, typename U>
-std::enable_if_t<sfinae::is_container_v<T> != sfinae::is_container_v<U> &&
-                     !sfinae::is_object_v<T> && !sfinae::is_object_v<U>,
-                 object>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_container_v<U>, object>
 operator+(const T &l, const U &r) {
-	throw std::invalid_argument{"size mismatch"};
+	auto result = unpack(view_of(l));
+	result += r;
+	return object(result);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_dense_v<U>, object>
+operator+(const T &l, const U &r) {
+	const auto &lv = view_of(l);
+	const auto &rv = view_of(r);
+	if (lv.shape != rv.shape)
+		return object(broadcast(lv, rv, add_into));
+	dense result(lv.shape);
+	add_into(result.view(), lv, rv);
+	return object(std::move(result));
+}
+// sparse plus sparse stays sparse, plus dense is dense
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_sparse_v<U>, object>
+operator+(const T &l, const U &r) {
+	return object(sparse_ops::combine(l, r, 1));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_sparse_v<U>, object>
+operator+(const T &l, const U &r) {
+	dense result(view_of(l));
+	sparse_ops::add_into(result.view(), r, 1);
+	return object(std::move(result));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_dense_v<U>, object>
+operator+(const T &l, const U &r) {
+	return r + l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_ragged_sparse_v<T, U>, object>
+operator+(const T &, const U &) {
+	unsupported_sparse();
+}
+// one element type stays typed, mixed ones compute in float64
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && sfinae::is_typed_v<U>, object>
+operator+(const T &l, const U &r) {
+	if (l.type() == r.type())
+		return object(typed_ops::combine(l, r, false));
+	return l.widen() + r.widen();
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_widened_v<T, U>, object> operator+(const T &l,
+                                                               const U &r) {
+	return widened(l) + widened(r);
+}
+// scalars stretch over the elements of the other side
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_flat_v<U>, object>
+operator+(const T &l, const U &r) {
+	object::container_impl result(l.begin(), l.end());
+	for (auto &a : result)
+		a = a + r;
+	return object(result);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_container_v<U>, object>
+operator+(const T &l, const U &r) {
+	object::container_impl result(r.begin(), r.end());
+	for (auto &a : result)
+		a = l + a;
+	return object(result);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_flat_v<U>, object>
+operator+(const T &l, const U &r) {
+	return object(broadcast(view_of(l), scalar_view(r), add_into));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_dense_v<U>, object>
+operator+(const T &l, const U &r) {
+	return object(broadcast(scalar_view(l), view_of(r), add_into));
 }
+// the element type stays when it holds the scalar exactly
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && sfinae::is_flat_v<U>, object>
+operator+(const T &l, const U &r) {
+	if (l.type() == dtype::int64 && typed_ops::keeps_type(l, r))
+		return object(typed_ops::shift(l, r, false));
+	auto result = l.widen() + r;
+	if (typed_ops::keeps_type(l, r))
+		return object(narrowed(result, l.type()));
+	return result;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_typed_v<U>, object>
+operator+(const T &l, const U &r) {
+	if (r.type() == dtype::int64 && typed_ops::keeps_type(r, l))
+		return object(typed_ops::shift(r, l, false));
+	auto result = l + r.widen();
+	if (typed_ops::keeps_type(r, l))
+		return object(narrowed(result, r.type()));
+	return result;
+}
+template <typename T, typename U>
+std::enable_if_t<(sfinae::is_sparse_v<T> && sfinae::is_flat_v<U>) ||
+                     (sfinae::is_flat_v<T> && sfinae::is_sparse_v<U>),
+                 object>
+operator+(const T &, const U &) {
+	unsupported_sparse();
+}
+} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U>, object>
 operator+(const T &l, const U &r) {
+	using ops_impl::operator+;
 	return l.visit([&](auto &underlaying) { return object(underlaying + r); });
 }
 template <typename T, typename U>
 std::enable_if_t<!sfinae::is_object_v<T> && sfinae::is_object_v<U>, object>
 operator+(const T &l, const U &r) {
+	using ops_impl::operator+;
 	return r.visit([&](auto &underlaying) { return object(l + underlaying); });
 }
-} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>, object>
 operator+(const T &l, const U &r) {
-	using ops_impl::operator+;
 	return r.visit([&](auto &underlaying) { return object(l + underlaying); });
 }
 
@@ -118,29 +487,105 @@ operator-=(T &l, const U &r) {
 	return l;
 }
 template <typename T, typename U>
-std::enable_if_t<sfinae::is_container_v<T> != sfinae::is_container_v<U> &&
-                     !sfinae::is_object_v<T> && !sfinae::is_object_v<U>,
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_dense_v<U>, T> &
+operator-=(T &l, const U &r) {
+	auto lv = view_of(l);
+	const auto &rv = view_of(r);
+	if (lv.shape != rv.shape)
+		broadcast_into(lv, lv, rv, subtract_into);
+	else
+		subtract_into(lv, lv, rv);
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_dense_v<U>, T> &
+operator-=(T &l, const U &r) {
+	return l -= unpack(view_of(r));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_container_v<U>, T> &
+operator-=(T &l, const U &r) {
+	return l -= pack_dense(r);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_sparse_v<U>, T> &
+operator-=(T &l, const U &r) {
+	l = sparse_ops::combine(l, r, -1);
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_sparse_v<U>, T> &
+operator-=(T &l, const U &r) {
+	sparse_ops::add_into(view_of(l), r, -1);
+	return l;
+}
+// scalars stretch over the elements of the left side
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_flat_v<U>, T> &
+operator-=(T &l, const U &r) {
+	for (auto &a : l)
+		a -= r;
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_flat_v<U>, T> &
+operator-=(T &l, const U &r) {
+	auto lv = view_of(l);
+	broadcast_into(lv, lv, scalar_view(r), subtract_into);
+	return l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_ragged_sparse_v<T, U> ||
+                     (sfinae::is_sparse_v<T> &&
+                      (sfinae::is_dense_v<U> || sfinae::is_flat_v<U>)),
                  T> &
+operator-=(T &, const U &) {
+	unsupported_sparse();
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && !sfinae::is_object_v<U>, T> &
+operator-=(T &l, const U &r) {
+	if constexpr (sfinae::is_flat_v<U>)
+		if (l.type() == dtype::int64 && typed_ops::keeps_type(l, r))
+			return l = typed_ops::shift(l, -r, false);
+	if constexpr (sfinae::is_typed_v<U>)
+		if (l.type() == r.type())
+			return l = typed_ops::combine(l, r, true);
+	auto result = l.widen();
+	result -= widened(r);
+	return l = typed_dense::from(result.view(), l.type());
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_widened_v<T, U> && !sfinae::is_typed_v<T>, T> &
 operator-=(T &l, const U &r) {
+	return l -= r.widen();
+}
+// a scalar left side cannot take the shape of the right one
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && !sfinae::is_flat_v<U> &&
+                     sfinae::is_plain_v<T, U>,
+                 T> &
+operator-=(T &, const U &) {
 	throw std::invalid_argument{"size mismatch"};
 }
+} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U>, T> &
 operator-=(T &l, const U &r) {
+	using ops_impl::operator-=;
 	l.visit([&](auto &underlaying) { underlaying -= r; });
 	return l;
 }
 template <typename T, typename U>
 std::enable_if_t<!sfinae::is_object_v<T> && sfinae::is_object_v<U>, T> &
 operator-=(T &l, const U &r) {
+	using ops_impl::operator-=;
 	r.visit([&](auto &underlaying) { l -= underlaying; });
 	return l;
 }
-} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>, T> &
 operator-=(T &l, const U &r) {
-	using ops_impl::operator-=;
 	r.visit([&](auto &underlaying) { l -= underlaying; });
 	return l;
 }
@@ -148,34 +593,143 @@ operator-=(T &l, const U &r) {
 //-
 namespace ops_impl {
 template <typename T, typename U>
-std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_container_v<U>, object>
+std::enable_if_t<sfinae::is_container_v<T> &&
+                     (sfinae::is_container_v<U> || sfinae::is_dense_v<U>),
+                 object>
 operator-(const T &l, const U &r) {
 	object::container_impl result(l.begin(), l.end());
 	result -= r;
 	return object(result);
 }
 template <typename T, typename U>
-std::enable_if_t<sfinae::is_container_v<T> != sfinae::is_container_v<U> &&
-                     !sfinae::is_object_v<T> && !sfinae::is_object_v<U>,
-                 object>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_container_v<U>, object>
 operator-(const T &l, const U &r) {
-	throw std::invalid_argument{"size mismatch"};
+	auto result = unpack(view_of(l));
+	result -= r;
+	return object(result);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_dense_v<U>, object>
+operator-(const T &l, const U &r) {
+	const auto &lv = view_of(l);
+	const auto &rv = view_of(r);
+	if (lv.shape != rv.shape)
+		return object(broadcast(lv, rv, subtract_into));
+	dense result(lv.shape);
+	subtract_into(result.view(), lv, rv);
+	return object(std::move(result));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_sparse_v<U>, object>
+operator-(const T &l, const U &r) {
+	return object(sparse_ops::combine(l, r, -1));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_sparse_v<U>, object>
+operator-(const T &l, const U &r) {
+	dense result(view_of(l));
+	sparse_ops::add_into(result.view(), r, -1);
+	return object(std::move(result));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_dense_v<U>, object>
+operator-(const T &l, const U &r) {
+	const auto &rv = view_of(r);
+	sparse_ops::check_shape(l, rv.shape);
+	// 0 - x as dense operands give it, never -0
+	dense result(rv.shape);
+	subtract_into(result.view(), result.view(), rv);
+	sparse_ops::add_into(result.view(), l, 1);
+	return object(std::move(result));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_ragged_sparse_v<T, U>, object>
+operator-(const T &, const U &) {
+	unsupported_sparse();
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && sfinae::is_typed_v<U>, object>
+operator-(const T &l, const U &r) {
+	if (l.type() == r.type())
+		return object(typed_ops::combine(l, r, true));
+	return l.widen() - r.widen();
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_widened_v<T, U>, object> operator-(const T &l,
+                                                               const U &r) {
+	return widened(l) - widened(r);
+}
+// scalars stretch over the elements of the other side
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_container_v<T> && sfinae::is_flat_v<U>, object>
+operator-(const T &l, const U &r) {
+	object::container_impl result(l.begin(), l.end());
+	for (auto &a : result)
+		a = a - r;
+	return object(result);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_container_v<U>, object>
+operator-(const T &l, const U &r) {
+	object::container_impl result(r.begin(), r.end());
+	for (auto &a : result)
+		a = l - a;
+	return object(result);
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_flat_v<U>, object>
+operator-(const T &l, const U &r) {
+	return object(broadcast(view_of(l), scalar_view(r), subtract_into));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_dense_v<U>, object>
+operator-(const T &l, const U &r) {
+	return object(broadcast(scalar_view(l), view_of(r), subtract_into));
 }
+// the element type stays when it holds the scalar exactly
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && sfinae::is_flat_v<U>, object>
+operator-(const T &l, const U &r) {
+	if (l.type() == dtype::int64 && typed_ops::keeps_type(l, r))
+		return object(typed_ops::shift(l, -r, false));
+	auto result = l.widen() - r;
+	if (typed_ops::keeps_type(l, r))
+		return object(narrowed(result, l.type()));
+	return result;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_typed_v<U>, object>
+operator-(const T &l, const U &r) {
+	if (r.type() == dtype::int64 && typed_ops::keeps_type(r, l))
+		return object(typed_ops::shift(r, l, true));
+	auto result = l - r.widen();
+	if (typed_ops::keeps_type(r, l))
+		return object(narrowed(result, r.type()));
+	return result;
+}
+template <typename T, typename U>
+std::enable_if_t<(sfinae::is_sparse_v<T> && sfinae::is_flat_v<U>) ||
+                     (sfinae::is_flat_v<T> && sfinae::is_sparse_v<U>),
+                 object>
+operator-(const T &, const U &) {
+	unsupported_sparse();
+}
+} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U>, object>
 operator-(const T &l, const U &r) {
+	using ops_impl::operator-;
 	return l.visit([&](auto &underlaying) { return object(underlaying - r); });
 }
 template <typename T, typename U>
 std::enable_if_t<!sfinae::is_object_v<T> && sfinae::is_object_v<U>, object>
 operator-(const T &l, const U &r) {
+	using ops_impl::operator-;
 	return r.visit([&](auto &underlaying) { return object(l - underlaying); });
 }
-} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>, object>
 operator-(const T &l, const U &r) {
-	using ops_impl::operator-;
 	return r.visit([&](auto &underlaying) { return object(l - underlaying); });
 }
 
@@ -200,20 +754,98 @@ operator*(const T &l, const U &r) {
 	return object(result);
 }
 template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_flat_v<U>, object>
+operator*(const T &l, const U &r) {
+	const auto &lv = view_of(l);
+	dense result(lv.shape);
+	scale_into(result.view(), lv, r);
+	return object(std::move(result));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_dense_v<U>, object>
+operator*(const T &l, const U &r) {
+	return r * l;
+}
+// every element of l times the whole r, as the nested path does
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_dense_v<T> && sfinae::is_dense_v<U>, object>
+operator*(const T &l, const U &r) {
+	auto lv = dense(view_of(l));
+	auto rv = dense(view_of(r));
+	shape_t shape = lv.shape();
+	shape.insert(shape.end(), rv.shape().begin(), rv.shape().end());
+	dense result(shape);
+	double *out = result.data();
+	for (size_t i = 0; i != lv.count(); i++)
+		for (size_t j = 0; j != rv.count(); j++)
+			*out++ = lv.data()[i] * rv.data()[j];
+	return object(std::move(result));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_sparse_v<T> && sfinae::is_flat_v<U>, object>
+operator*(const T &l, const U &r) {
+	return object(sparse_ops::scale(l, r));
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_sparse_v<U>, object>
+operator*(const T &l, const U &r) {
+	return r * l;
+}
+// products with sparse matrices go through @
+template <typename T, typename U>
+std::enable_if_t<(sfinae::is_sparse_v<T> &&
+                  (sfinae::is_sparse_v<U> || sfinae::is_dense_v<U>)) ||
+                     (sfinae::is_dense_v<T> && sfinae::is_sparse_v<U>),
+                 object>
+operator*(const T &, const U &) {
+	unsupported_sparse();
+}
+// scalars take the element type when it holds them exactly
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && sfinae::is_flat_v<U>, object>
+operator*(const T &l, const U &r) {
+	if (typed_ops::keeps_type(l, r))
+		return object(typed_ops::scale(l, r));
+	return l.widen() * r;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_flat_v<T> && sfinae::is_typed_v<U>, object>
+operator*(const T &l, const U &r) {
+	return r * l;
+}
+template <typename T, typename U>
+std::enable_if_t<sfinae::is_typed_v<T> && sfinae::is_typed_v<U>, object>
+operator*(const T &l, const U &r) {
+	auto result = l.widen() * r.widen();
+	if (l.type() == r.type())
+		return object(narrowed(result, l.type()));
+	return result;
+}
+template <typename T, typename U>
+std::enable_if_t<(sfinae::is_typed_v<T> &&
+                  (sfinae::is_dense_v<U> || sfinae::is_sparse_v<U>)) ||
+                     ((sfinae::is_dense_v<T> || sfinae::is_sparse_v<T>) &&
+                      sfinae::is_typed_v<U>),
+                 object>
+operator*(const T &l, const U &r) {
+	return widened(l) * widened(r);
+}
+} // namespace ops_impl
+template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U>, object>
 operator*(const T &l, const U &r) {
+	using ops_impl::operator*;
 	return l.visit([&](auto &underlaying) { return object(underlaying * r); });
 }
 template <typename T, typename U>
 std::enable_if_t<!sfinae::is_object_v<T> && sfinae::is_object_v<U>, object>
 operator*(const T &l, const U &r) {
+	using ops_impl::operator*;
 	return r.visit([&](auto &underlaying) { return object(l * underlaying); });
 }
-} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>, object>
 operator*(const T &l, const U &r) {
-	using ops_impl::operator*;
 	return r.visit([&](auto &underlaying) { return object(l * underlaying); });
 }
 
@@ -221,30 +853,76 @@ operator*(const T &l, const U &r) {
 namespace ops_impl {
 template <typename T, typename U, typename Unp>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
-                 !sfinae::is_container_v<U> && !sfinae::is_container_v<Unp>>
-update(T &l, const U &r, Unp &unpacked) {
+                 sfinae::is_flat_v<U> && sfinae::is_flat_v<Unp>>
+update(T &, const U &r, Unp &unpacked) {
 	unpacked = r;
 }
 template <typename T, typename U, typename Unp>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
-                 sfinae::is_container_v<U> != sfinae::is_container_v<Unp> &&
+                 sfinae::is_flat_v<U> != sfinae::is_flat_v<Unp> &&
                  !std::is_same_v<T, object>>
-update(T &l, const U &r, Unp &unpacked) {}
+update(T &, const U &, Unp &) {}
 template <typename T, typename U, typename Unp>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
-                 sfinae::is_container_v<U> != sfinae::is_container_v<Unp> &&
+                 sfinae::is_flat_v<U> != sfinae::is_flat_v<Unp> &&
                  std::is_same_v<T, object>>
-update(T &l, const U &r, Unp &unpacked) {
+update(T &l, const U &r, Unp &) {
 	l = object(r);
 }
 template <typename T, typename U, typename Unp>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
                  sfinae::is_container_v<U> && sfinae::is_container_v<Unp>>
-update(T &l, const U &r, Unp &unpacked) {
+update(T &, const U &r, Unp &unpacked) {
 	assert(r.size() == unpacked.size());
 	std::copy(r.begin(), r.end(), unpacked.begin());
 }
 template <typename T, typename U, typename Unp>
+std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
+                 sfinae::is_dense_v<U> && sfinae::is_container_v<Unp>>
+update(T &l, const U &r, Unp &unpacked) {
+	update(l, unpack(view_of(r)), unpacked);
+}
+template <typename T, typename U, typename Unp>
+std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
+                 sfinae::is_dense_v<U> && sfinae::is_dense_v<Unp>>
+update(T &, const U &r, Unp &unpacked) {
+	auto lv = view_of(unpacked);
+	const auto &rv = view_of(r);
+	if (lv.shape != rv.shape)
+		throw std::invalid_argument{"size mismatch"};
+	copy_into(lv, rv);
+}
+template <typename T, typename U, typename Unp>
+std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
+                 sfinae::is_container_v<U> && sfinae::is_dense_v<Unp>>
+update(T &l, const U &r, Unp &unpacked) {
+	update(l, pack_dense(r), unpacked);
+}
+// sparse storage is only ever replaced as a whole
+template <typename T, typename U, typename Unp>
+std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
+                 !sfinae::is_flat_v<U> && !sfinae::is_flat_v<Unp> &&
+                 (sfinae::is_sparse_v<U> || sfinae::is_sparse_v<Unp>)>
+update(T &l, const U &r, Unp &) {
+	if constexpr (std::is_same_v<T, object>)
+		l = object(r);
+	else
+		unsupported_sparse();
+}
+// typed storage is replaced as a whole too, slices of other arrays take the
+// values in float64
+template <typename T, typename U, typename Unp>
+std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U> &&
+                 !sfinae::is_flat_v<U> && !sfinae::is_flat_v<Unp> &&
+                 !sfinae::is_sparse_v<U> && !sfinae::is_sparse_v<Unp> &&
+                 (sfinae::is_typed_v<U> || sfinae::is_typed_v<Unp>)>
+update(T &l, const U &r, Unp &unpacked) {
+	if constexpr (std::is_same_v<T, object>)
+		l = object(r);
+	else
+		update(l, widened(r), unpacked);
+}
+template <typename T, typename U, typename Unp>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>>
 update(T &l, const U &r, Unp &unpacked) {
 	r.visit([&](auto &a) { update(l, a, unpacked); });
@@ -253,22 +931,72 @@ template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T>> update(T &l, const U &r) {
 	l.visit([&](auto &a) { update(l, r, a); });
 }
+} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && !sfinae::is_object_v<U>, T> &
 operator*=(T &l, const U &r) {
 	auto result = l * r;
-	update(l, result);
+	ops_impl::update(l, result);
 	return l;
 }
-} // namespace ops_impl
 template <typename T, typename U>
 std::enable_if_t<sfinae::is_object_v<T> && sfinae::is_object_v<U>, T> &
 operator*=(T &l, const U &r) {
-	using ops_impl::operator*=;
 	r.visit([&](auto &underlaying) { l *= underlaying; });
 	return l;
 }
 
+//@
+namespace ops_impl {
+// sparse times sparse stays sparse, with a dense side the result is dense
+inline object sparse_matmul(const object &l, const object &r) {
+	if (l.sparse() && r.sparse())
+		return object(sparse_ops::multiply(l.sparse_data(), r.sparse_data()));
+	if (l.sparse() && r.packed())
+		return object(sparse_ops::multiply(l.sparse_data(), r.packed_data()));
+	if (l.packed() && r.sparse())
+		return object(sparse_ops::multiply(l.packed_data(), r.sparse_data()));
+	throw std::invalid_argument{"matrix operands expected"};
+}
+} // namespace ops_impl
+// matrix product of rank 1 or 2 dense operands, vectors act as row or column
+inline object matmul(const object &l, const object &r) {
+	if (l.typed() || r.typed())
+		return matmul(l.typed() ? object(l.typed_data().widen()) : l,
+		              r.typed() ? object(r.typed_data().widen()) : r);
+	if (l.sparse() || r.sparse())
+		return ops_impl::sparse_matmul(l, r);
+	if (!l.packed() || !r.packed() || l.packed_data().rank() > 2 ||
+	    r.packed_data().rank() > 2)
+		throw std::invalid_argument{"matrix operands expected"};
+	auto &a = l.packed_data();
+	auto &b = r.packed_data();
+	size_t k = a.shape().back();
+	if (b.shape()[0] != k)
+		throw std::invalid_argument{"size mismatch"};
+	if (a.rank() == 1 && b.rank() == 1) {
+		double sum = 0;
+		gemm::multiply_vector(1, k, a.data(), k, b.data(), &sum);
+		return object(sum);
+	}
+	if (b.rank() == 1) {
+		dense result({a.shape()[0]});
+		gemm::multiply_vector(a.shape()[0], k, a.data(), k, b.data(),
+		                      result.data());
+		return object(std::move(result));
+	}
+	size_t n = b.shape()[1];
+	if (a.rank() == 1) {
+		dense result({n});
+		gemm::vector_multiply(k, n, a.data(), b.data(), n, result.data());
+		return object(std::move(result));
+	}
+	size_t m = a.shape()[0];
+	dense result({m, n});
+	gemm::multiply(m, n, k, a.data(), k, b.data(), n, result.data(), n);
+	return object(std::move(result));
+}
+
 //<<
 namespace ops_impl {
 template <typename T>
@@ -281,6 +1009,63 @@ operator<<(std::ostream &os, const T &o) {
 	os << ']';
 	return os;
 }
+template <typename T>
+std::enable_if_t<sfinae::is_dense_v<T>, std::ostream> &
+operator<<(std::ostream &os, const T &o) {
+	const auto &v = view_of(o);
+	os << '[';
+	for (size_t i = 0; i != v.size(); i++)
+		if (v.rank() == 1)
+			os << *v.row(i) << ", ";
+		else
+			os << v.sub(i) << ", ";
+	os << "\b\b";
+	os << ']';
+	return os;
+}
+// as the call that builds it again: sparse(rows, columns, i, j, values)
+template <typename T>
+std::enable_if_t<sfinae::is_sparse_v<T>, std::ostream> &
+operator<<(std::ostream &os, const T &o) {
+	os << "sparse(" << o.rows() << ", " << o.columns();
+	if (o.nnz() != 0) {
+		auto list = [&](auto element) {
+			os << ", [";
+			for (size_t i = 0; i != o.rows(); i++)
+				for (size_t p = o.offsets()[i]; p != o.offsets()[i + 1]; p++)
+					os << (p != 0 ? ", " : "") << element(i, p);
+			os << ']';
+		};
+		list([](size_t i, size_t) { return i; });
+		list([&](size_t, size_t p) { return o.indices()[p]; });
+		list([&](size_t, size_t p) { return o.values()[p]; });
+	}
+	os << ')';
+	return os;
+}
+// nested like dense objects, int64 elements in full
+template <typename T>
+std::enable_if_t<sfinae::is_typed_v<T>, std::ostream> &
+operator<<(std::ostream &os, const T &o) {
+	auto strides = contiguous_strides(o.shape());
+	auto print = [&](auto &self, size_t dim, size_t offset) -> void {
+		os << '[';
+		for (size_t i = 0; i != o.shape()[dim]; i++) {
+			size_t at = offset + i * strides[dim];
+			if (dim + 1 != o.rank())
+				self(self, dim + 1, at);
+			else if (o.type() == dtype::float32)
+				os << o.template data<float>()[at];
+			else
+				os << o.template data<int64_t>()[at];
+			os << ", ";
+		}
+		os << "\b\b";
+		os << ']';
+	};
+	print(print, 0, 0);
+	return os;
+}
 } // namespace ops_impl
 template <typename T>
 std::enable_if_t<sfinae::is_object_v<T>, std::ostream> &
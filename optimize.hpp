@@ -0,0 +1,190 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include "program.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace matlang {
+// rewrites compiled code as a dag: subtrees of constants fold, identical
+// subtrees are computed once and kept in temporaries, +a, --a, 1 * a, a * 1
+// and a - 0 reduce to a, and a - a becomes zeros shaped like a (so NaN and
+// infinite elements give 0 there)
+namespace optimize {
+namespace impl {
+struct node {
+	opcode op;
+	size_t arg; // constant, link or call index
+	std::vector<size_t> in;
+};
+
+// fold(op, arg, args, out) evaluates op on constants into out, false when the
+// operation has to wait for run time
+template <typename Fold> class builder {
+public:
+	builder(program &p, const Fold &fold) : p{p}, fold{fold} {}
+
+	void run() {
+		std::vector<size_t> stack;
+		auto pop = [&](size_t n) {
+			std::vector<size_t> in(stack.end() - n, stack.end());
+			stack.resize(stack.size() - n);
+			return in;
+		};
+		for (auto ins : p.code) {
+			switch (ins.op) {
+			case opcode::constant:
+			case opcode::load:
+				stack.push_back(add({ins.op, ins.arg, {}}));
+				break;
+			case opcode::pack:
+				stack.push_back(add({ins.op, ins.arg, pop(ins.arg)}));
+				break;
+			case opcode::call:
+				stack.push_back(add({ins.op, ins.arg, pop(p.calls[ins.arg].argc)}));
+				break;
+			case opcode::negate:
+			case opcode::identity:
+			case opcode::zero:
+				stack.push_back(add({ins.op, 0, pop(1)}));
+				break;
+			default:
+				stack.push_back(add({ins.op, 0, pop(2)}));
+				break;
+			}
+		}
+		size_t root = stack.back();
+		uses.assign(nodes.size(), 0);
+		count_uses(root);
+		temp.assign(nodes.size(), none);
+		std::vector<object> constants;
+		constants.swap(p.constants);
+		p.clear_code();
+		emit(root, constants);
+	}
+
+private:
+	constexpr static size_t none = ~size_t{0};
+
+	bool constant(size_t id) const { return nodes[id].op == opcode::constant; }
+	bool is(size_t id, double v) const {
+		if (!constant(id))
+			return false;
+		auto &o = p.constants[nodes[id].arg];
+		return o.flat() && o.value() == v;
+	}
+
+	size_t add(node n) {
+		switch (n.op) {
+		case opcode::identity:
+			return n.in[0];
+		case opcode::negate:
+			if (nodes[n.in[0]].op == opcode::negate)
+				return nodes[n.in[0]].in[0];
+			break;
+		case opcode::multiply:
+			if (is(n.in[0], 1))
+				return n.in[1];
+			if (is(n.in[1], 1))
+				return n.in[0];
+			break;
+		case opcode::subtract:
+			if (is(n.in[1], 0))
+				return n.in[0];
+			if (n.in[0] == n.in[1])
+				n = {opcode::zero, 0, {n.in[0]}};
+			break;
+		default:
+			break;
+		}
+		if (n.op != opcode::constant && n.op != opcode::load && !n.in.empty() &&
+		    std::all_of(n.in.begin(), n.in.end(),
+		                [&](size_t id) { return constant(id); })) {
+			std::vector<object> args;
+			for (size_t id : n.in)
+				args.push_back(p.constants[nodes[id].arg]);
+			object result;
+			if (fold(n.op, n.arg, std::move(args), result)) {
+				p.constants.push_back(std::move(result));
+				n = {opcode::constant, p.constants.size() - 1, {}};
+			}
+		}
+		// constants are leaves, key() matches them by value
+		if (n.op == opcode::constant) {
+			nodes.push_back(std::move(n));
+			return nodes.size() - 1;
+		}
+		auto [it, inserted] = ids.emplace(key(n), nodes.size());
+		if (inserted)
+			nodes.push_back(std::move(n));
+		return it->second;
+	}
+	// inputs of equal numbers, loads of equal links and calls of the same
+	// builtin compare equal; numbers match bit for bit, so -0 stays apart from 0
+	std::tuple<opcode, size_t, std::vector<size_t>> key(const node &n) {
+		std::vector<size_t> in = n.in;
+		for (auto &id : in)
+			if (constant(id) && p.constants[nodes[id].arg].flat()) {
+				uint64_t bits;
+				double v = p.constants[nodes[id].arg].value();
+				std::memcpy(&bits, &v, sizeof bits);
+				id = numbers.emplace(bits, id).first->second;
+			}
+		size_t arg = n.arg;
+		if (n.op == opcode::load) {
+			auto &l = p.links[arg];
+			for (size_t j = 0; j != arg; j++)
+				if (p.links[j].slot == l.slot && p.links[j].sl == l.sl) {
+					arg = j;
+					break;
+				}
+		} else if (n.op == opcode::call)
+			arg = reinterpret_cast<size_t>(p.calls[arg].fn);
+		return {n.op, arg, std::move(in)};
+	}
+
+	void count_uses(size_t id) {
+		if (uses[id]++ != 0)
+			return;
+		for (size_t in : nodes[id].in)
+			count_uses(in);
+	}
+	void emit(size_t id, std::vector<object> &constants) {
+		auto &n = nodes[id];
+		if (temp[id] != none)
+			return p.emit(opcode::reuse, temp[id]);
+		for (size_t in : n.in)
+			emit(in, constants);
+		if (n.op == opcode::constant) {
+			p.constants.push_back(constants[n.arg]);
+			return p.emit(opcode::constant, p.constants.size() - 1);
+		}
+		p.emit(n.op, n.arg);
+		if (uses[id] > 1 && n.op != opcode::load) {
+			temp[id] = temps++;
+			p.emit(opcode::keep, temp[id]);
+		}
+	}
+
+	program &p;
+	const Fold &fold;
+	std::vector<node> nodes;
+	std::map<std::tuple<opcode, size_t, std::vector<size_t>>, size_t> ids;
+	std::unordered_map<uint64_t, size_t> numbers;
+	std::vector<size_t> uses, temp;
+	size_t temps{};
+};
+} // namespace impl
+
+template <typename Fold> void run(program &p, const Fold &fold) {
+	impl::builder<Fold>(p, fold).run();
+}
+} // namespace optimize
+} // namespace matlang
+
+#endif /* end of include guard: OPTIMIZE_HPP */
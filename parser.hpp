@@ -1,14 +1,23 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
+#include "csv.hpp"
+#include "lazy.hpp"
+#include "lexer.hpp"
 #include "object.hpp"
-#include <cctype>
-#include <functional>
+#include "optimize.hpp"
+#include "program.hpp"
+#include "symbols.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include "workspace.hpp"
 #include <iostream>
-#include <list>
 #include <map>
+#include <memory>
+#include <sstream>
 #include <stack>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 namespace matlang {
 
@@ -20,85 +29,66 @@ struct parse_error : std::exception {
 	const char *what() const throw() override { return line_.c_str(); }
 };
 class parser {
-	std::map<std::string, object> vars;
-	std::list<object> temp_vars;
+	symbol_table vars;
 
 	size_t implicit_space(size_t start, const std::string &line) {
-		size_t i = start;
-		while (i < line.size() && std::isspace(line[i]))
-			i++;
+		return lexer::skip_space(line, start);
+	}
+	// a whole number up to the largest size_t
+	size_t parse_size(size_t start, const std::string &line, size_t &result) {
+		size_t i = lexer::scan_digits(line, start);
+		if (i == start ||
+		    !lexer::to_index(std::string_view(line).substr(start, i - start), result))
+			throw parse_error(start, "size");
 		return i;
 	}
 	size_t parse_index(size_t start, const std::string &line, size_t &result) {
 		size_t i = start;
-		std::string num;
-		if (i >= line.size() || !isdigit(line[i]))
+		if (i >= line.size() || !lexer::is_digit(line[i]))
 			throw parse_error(i, "index");
-		if (line[i] == '0') {
-			i++;
-			result = 0;
-			return i;
-		}
-		while (i < line.size() && isdigit(line[i])) {
-			num.push_back(line[i]);
-			i++;
-		}
-		if (num.size() > 9)
+		i = line[i] == '0' ? i + 1 : lexer::scan_digits(line, i);
+		if (i - start > 9 ||
+		    !lexer::to_index(std::string_view(line).substr(start, i - start), result))
 			throw parse_error(i, "index");
-		size_t err;
-		result = stoull(num, &err);
 		return i;
 	}
 	size_t parse_float(size_t start, const std::string &line, double &result) {
-		size_t i = start;
-		std::string num;
-		if (i < line.size() && line[i] == '-') {
-			num.push_back('-');
-			i++;
-		}
-		if (i >= line.size() || !isdigit(line[i]))
-			throw parse_error(i, "float");
-		if (i < line.size() && line[i] == '0') {
-			num.push_back('0');
-			i++;
-		} else
-			while (i < line.size() && isdigit(line[i])) {
-				num.push_back(line[i]);
-				i++;
-			}
-		if (i < line.size() && line[i] == '.') {
-			num.push_back(line[i]);
-			i++;
-			while (i < line.size() && isdigit(line[i])) {
-				num.push_back(line[i]);
-				i++;
-			}
-		}
-		size_t err;
-		result = stod(num, &err);
-		return i;
+		auto t = lexer::next(line, start);
+		if (t.k != lexer::kind::number || !lexer::to_double(t.text, result))
+			throw parse_error(start, "float");
+		return t.end;
 	}
 	size_t parse_identifier(size_t start, const std::string &line,
 	                        std::string &result) {
-		size_t i = start;
-		std::string name;
-		if (i >= line.size() || !(isalpha(line[i]) || line[i] == '_'))
-			throw parse_error(i, "identifier");
-		while (i < line.size() && (isalnum(line[i]) || line[i] == '_')) {
-			name.push_back(line[i]);
-			i++;
-		}
-		result = move(name);
-		return i;
+		auto t = lexer::next(line, start);
+		if (t.k != lexer::kind::identifier)
+			throw parse_error(start, "identifier");
+		result.assign(t.text);
+		return t.end;
 	}
 	size_t parse_slice(size_t start, const std::string &line, slice &result) {
 		size_t i = start;
-		result.clear();
+		result = slice();
 		while (true) {
 			size_t id;
 			i = parse_index(i, line, id);
-			result.push_back(id);
 			i = implicit_space(i, line);
+			if (i < line.size() && line[i] == ':') {
+				// start:stop[:step], stop is exclusive
+				size_t stop, step = 1;
+				i = parse_index(implicit_space(i + 1, line), line, stop);
+				i = implicit_space(i, line);
+				if (i < line.size() && line[i] == ':') {
+					i = parse_index(implicit_space(i + 1, line), line, step);
+					if (step == 0)
+						throw parse_error(i, "positive step");
+					i = implicit_space(i, line);
+				}
+				if (stop <= id)
+					throw parse_error(i, "non-empty range");
+				result.push_back(slice::range(id, (stop - id + step - 1) / step, step));
+			} else
+				result.push_back(slice{id});
 			if (i >= line.size() || line[i] != ',')
 				break;
 			i++;
@@ -106,18 +96,17 @@ class parser {
 		}
 		return i;
 	}
-	size_t parse_object(size_t start, const std::string &line, object &result) {
+	size_t compile_object(size_t start, const std::string &line, program &p) {
 		size_t i = start;
 		if (i >= line.size())
 			throw parse_error(i, "object");
 		if (line[i] == '[') {
-			object::container_impl container;
+			size_t n = 0;
 			i++;
 			while (true) {
 				i = implicit_space(i, line);
-				object o;
-				i = eval_expression(i, line, o);
-				container.push_back(std::move(o));
+				i = compile_expression(i, line, p);
+				n++;
 				i = implicit_space(i, line);
 				if (i >= line.size() || line[i] != ',')
 					break;
@@ -126,11 +115,11 @@ class parser {
 			if (i >= line.size() || line[i] != ']')
 				throw parse_error(i, "]");
 			i++;
-			result = object(move(container));
+			p.emit_pack(n);
 		} else {
 			double d;
 			i = parse_float(i, line, d);
-			result = object(d);
+			p.emit_constant(object(d));
 		}
 		return i;
 	}
@@ -154,150 +143,530 @@ class parser {
 		}
 		return i;
 	}
-	using operand = std::variant<view_link, object>;
-	size_t parse_operand(size_t start, const std::string &line, operand &result) {
+	// the first character decides between a variable and a literal
+	size_t compile_operand(size_t start, const std::string &line, program &p) {
 		size_t i = start;
-		try {
+		if (i < line.size() && lexer::is_alpha(line[i])) {
+			auto name = lexer::next(line, i);
+			size_t open = implicit_space(name.end, line);
+			if (open < line.size() && line[open] == '(')
+				return compile_call(name, open, line, p);
 			view_link vl;
 			i = parse_view_link(i, line, vl);
-			result = std::move(vl);
-		} catch (parse_error &) {
-			try {
-				object obj;
-				i = parse_object(i, line, obj);
-				result = std::move(obj);
-			} catch (parse_error &err) {
-				std::cerr << err.what() << std::endl;
-				throw parse_error(i, "operand");
-			}
+			p.emit(opcode::load, p.add_link(vars.intern(vl.name), std::move(vl.sl)));
+			return i;
 		}
-		return i;
+		if (i < line.size() && (line[i] == '[' || lexer::scan_number(line, i) != i))
+			return compile_object(i, line, p);
+		throw parse_error(i, "operand");
+	}
+	// name(expression, ...) of a builtin
+	size_t compile_call(const lexer::token &name, size_t open,
+	                    const std::string &line, program &p) {
+		auto fn = builtins::find(name.text);
+		if (!fn)
+			throw parse_error(name.pos, "function");
+		size_t i = implicit_space(open + 1, line);
+		size_t argc = 0;
+		while (i < line.size() && line[i] != ')') {
+			i = compile_expression(i, line, p);
+			argc++;
+			if (i >= line.size() || line[i] != ',')
+				break;
+			i = implicit_space(i + 1, line);
+		}
+		if (i >= line.size() || line[i] != ')')
+			throw parse_error(i, ")");
+		if (argc < fn->min_args || argc > fn->max_args)
+			throw parse_error(i, std::to_string(fn->min_args) +
+			                         (fn->min_args == fn->max_args
+			                              ? ""
+			                              : " to " + std::to_string(fn->max_args)) +
+			                         " arguments");
+		p.emit_call(fn, argc);
+		return i + 1;
+	}
+	// selected part of a dense object, a rank 0 view stands for one element
+	dense_view select(const dense_view &v, const std::vector<slice> &sl,
+	                  size_t dim) {
+		if (sl.size() == dim)
+			return v;
+		if (sl[dim].max() >= v.size())
+			throw std::invalid_argument("index out of bounds");
+		if (dim == sl.size() - 1) {
+			if (sl[dim].size() != 1)
+				return v.gather(sl[dim]);
+			if (v.rank() == 1)
+				return {v.row(sl[dim][0]), {}, {}, {}};
+			return v.sub(sl[dim][0]);
+		}
+		if (sl[dim].size() == 1) {
+			size_t id = sl[dim][0];
+			if (v.rank() > 1)
+				return select(v.sub(id), sl, dim + 1);
+			throw std::invalid_argument("invalid dimension");
+		}
+		throw std::invalid_argument("slices are allowed only on a final dimension");
+	}
+	object get(const dense_view &v, const std::vector<slice> &sl, size_t dim) {
+		auto selected = select(v, sl, dim);
+		if (selected.rank() == 0)
+			return object(*selected.data);
+		return object(dense(selected));
+	}
+	// rows of a sparse matrix stay sparse, a single row or elements of one are
+	// dense
+	object get(const sparse &s, const std::vector<slice> &sl, size_t dim) {
+		if (sl.size() - dim > 2)
+			throw std::invalid_argument("invalid dimension");
+		auto &rows = sl[dim];
+		if (rows.max() >= s.rows())
+			throw std::invalid_argument("index out of bounds");
+		if (dim == sl.size() - 1) {
+			if (rows.size() == 1)
+				return object(s.row(rows[0]));
+			return object(s.select_rows(rows));
+		}
+		if (rows.size() != 1)
+			throw std::invalid_argument("slices are allowed only on a final dimension");
+		auto &columns = sl[dim + 1];
+		if (columns.max() >= s.columns())
+			throw std::invalid_argument("index out of bounds");
+		if (columns.size() == 1)
+			return object(s.at(rows[0], columns[0]));
+		dense result({columns.size()});
+		for (size_t k = 0; k != columns.size(); k++)
+			result.data()[k] = s.at(rows[0], columns[k]);
+		return object(std::move(result));
+	}
+	// copies of the picked blocks in the same element type
+	object get(const typed_dense &t, const std::vector<slice> &sl, size_t dim) {
+		shape_t shape;
+		size_t block;
+		auto offsets = t.pick(sl, dim, shape, block);
+		if (shape.empty())
+			return object(t.element(offsets[0]));
+		typed_dense result(t.type(), std::move(shape));
+		size_t element = element_size(t.type()), bytes = block * element;
+		char *out = result.data<char>();
+		for (size_t k = 0; k != offsets.size(); k++)
+			std::memcpy(out + k * bytes, t.data<char>() + offsets[k] * element, bytes);
+		return object(std::move(result));
 	}
-	object get(object op) { return std::move(op); }
-	object get(object &o, std::vector<slice> sl, size_t dim = 0) {
+	object get(object &o, const std::vector<slice> &sl, size_t dim = 0) {
 		if (sl.size() == dim)
 			return o;
-		if (*std::max_element(sl[dim].begin(), sl[dim].end()) >= o.size())
+		if (o.packed())
+			return get(o.packed_data().view(), sl, dim);
+		if (o.sparse())
+			return get(o.sparse_data(), sl, dim);
+		if (o.typed())
+			return get(o.typed_data(), sl, dim);
+		if (sl[dim].max() >= o.size())
 			throw std::invalid_argument("index out of bounds");
 		if (dim == sl.size() - 1)
 			if (sl[dim].size() == 1) {
 				return o[sl[dim][0]];
 			} else
-				return o[std::move(sl[dim])].copy();
+				return o[sl[dim]].copy();
 		if (sl[dim].size() == 1) {
 			size_t id = sl[dim][0];
 			if (!o.flat())
-				return get(o[id], move(sl), dim + 1);
+				return get(o[id], sl, dim + 1);
 			throw std::invalid_argument("invalid dimension");
 		}
 		throw std::invalid_argument("slices are allowed only on a final dimension");
 	}
-	object get(view_link op) {
-		auto vari = vars.find(op.name);
-		if (vari == vars.end())
-			throw std::invalid_argument(op.name + " is not defined");
-		return get(vari->second, std::move(op.sl));
-	}
-	object get(operand op) {
-		return std::visit([this](auto a) { return get(std::move(a)); },
-		                  std::move(op));
-	}
-	object_view get_view(object op) {
-		temp_vars.push_back(std::move(op));
-		return temp_vars.back().view();
+	object_view get_view(const dense_view &v, const std::vector<slice> &sl, size_t dim) {
+		if (sl.size() == dim)
+			return object_view(v);
+		if (sl[dim].max() >= v.size())
+			throw std::invalid_argument("index out of bounds");
+		if (dim == sl.size() - 1) {
+			if (sl[dim].size() == 1 && v.rank() > 1)
+				return object_view(v.sub(sl[dim][0]));
+			return object_view(v.gather(sl[dim]));
+		}
+		if (sl[dim].size() == 1) {
+			size_t id = sl[dim][0];
+			if (v.rank() > 1)
+				return get_view(v.sub(id), sl, dim + 1);
+			throw std::invalid_argument("invalid dimension");
+		}
+		throw std::invalid_argument("slices are allowed only on a final dimension");
 	}
-	object_view get_view(object &o, std::vector<slice> sl, size_t dim = 0) {
+	object_view get_view(object &o, const std::vector<slice> &sl, size_t dim = 0,
+	                     bool ragged = false) {
+		if (ragged)
+			o.unpack();
 		if (sl.size() == dim)
 			return o.view();
-		if (*std::max_element(sl[dim].begin(), sl[dim].end()) >= o.size())
+		if (o.packed())
+			return get_view(o.packed_data().mutable_view(), sl, dim);
+		if (sl[dim].max() >= o.size())
 			throw std::invalid_argument("index out of bounds");
 		if (dim == sl.size() - 1)
 			if (sl[dim].size() == 1 && !o[sl[dim][0]].flat()) {
 				return o[sl[dim][0]].view();
 			} else
-				return o[std::move(sl[dim])];
+				return o[sl[dim]];
 		if (sl[dim].size() == 1) {
 			int id = sl[dim][0];
 			if (!o[id].flat())
-				return get_view(o[id], std::move(sl), dim + 1);
+				return get_view(o[id], sl, dim + 1, ragged);
 			throw std::invalid_argument("invalid dimension");
 		}
 		throw std::invalid_argument("slices are allowed only on a final dimension");
 	}
-	object_view get_view(view_link op) {
-		auto vari = vars.find(op.name);
-		if (vari == vars.end())
-			throw std::invalid_argument(op.name + " is not defined");
-		return get_view(vari->second, std::move(op.sl));
-	}
-	object_view get_view(operand op) {
-		return std::visit([this](auto a) { return get_view(std::move(a)); },
-		                  std::move(op));
-	}
-	std::map<char, size_t> priority{{'-', 1},  {'+', 1},  {'*', 3}, {')', 0},
-	                                {-'(', 0}, {-'-', 4}, {-'+', 4}};
-	std::map<char, bool> unary{
-	    {'(', true}, {'-', true}, {'+', true}, {'*', false}, {')', false}};
-	std::map<char, bool> binary{
-	    {'(', false}, {'-', true}, {'+', true}, {'*', true}, {')', true}};
-	std::map<char, std::function<object(object)>> unary_evaluators{
-	    {-'-',
-	     [&](auto a) {
-		     std::cout << a << " unary-" << std::endl;
-		     return object(-1) * a;
-	     }},
-	    {-'+', [&](auto a) {
-		     std::cout << a << " unary+" << std::endl;
-		     return object(1) * a;
-	     }}};
-	std::map<char, std::function<object(object, object)>> binary_evaluators{
-	    {'-',
-	     [&](auto a, auto b) {
-		     std::cout << a << " - " << b << std::endl;
-		     return a - b;
-	     }},
-	    {'+',
-	     [&](auto a, auto b) {
-		     std::cout << a << " + " << b << std::endl;
-		     return a + b;
-	     }},
-	    {'*', [&](auto a, auto b) {
-		     std::cout << a << " * " << b << std::endl;
-		     return a * b;
-	     }}};
-	void eval_impl(std::stack<operand> &operands, std::stack<char> &operators,
-	               size_t min_priority, parse_error err) {
-		while (!operands.empty() && !operators.empty() &&
+	// s[i][j] = x sets elements, s[rows] = x replaces whole rows
+	void assign_sparse(sparse &s, const std::vector<slice> &sl, const object &value) {
+		if (sl.size() > 2)
+			throw std::invalid_argument("invalid dimension");
+		auto &rows = sl[0];
+		if (rows.max() >= s.rows())
+			throw std::invalid_argument("index out of bounds");
+		if (sl.size() == 2) {
+			if (rows.size() != 1)
+				throw std::invalid_argument("slices are allowed only on a final dimension");
+			auto &columns = sl[1];
+			if (columns.max() >= s.columns())
+				throw std::invalid_argument("index out of bounds");
+			if (value.flat()) {
+				for (size_t k = 0; k != columns.size(); k++)
+					s.set(rows[0], columns[k], value.value());
+				return;
+			}
+			if (!value.packed() || value.packed_data().rank() != 1 ||
+			    value.packed_data().size() != columns.size())
+				throw std::invalid_argument("size mismatch");
+			for (size_t k = 0; k != columns.size(); k++)
+				s.set(rows[0], columns[k], value.packed_data().data()[k]);
+			return;
+		}
+		if (!value.packed() && !value.sparse())
+			throw std::invalid_argument("size mismatch");
+		dense d = value.sparse() ? value.sparse_data().to_dense() : value.packed_data();
+		if (rows.size() == 1 && d.rank() == 1)
+			return s.set_row(rows[0], d.view());
+		if (d.rank() != 2 || d.size() != rows.size())
+			throw std::invalid_argument("size mismatch");
+		for (size_t k = 0; k != rows.size(); k++)
+			s.set_row(rows[k], d.view().sub(k));
+	}
+	// the picked blocks take the value rounded to the element type, which
+	// must have the shape of the selection
+	void assign_typed(typed_dense &t, const std::vector<slice> &sl,
+	                  const object &value) {
+		shape_t shape;
+		size_t block;
+		auto offsets = t.pick(sl, 0, shape, block);
+		typed_dense source;
+		if (value.typed() && value.typed_data().type() == t.type())
+			source = value.typed_data();
+		else {
+			dense d;
+			if (value.flat()) {
+				d = dense({1});
+				d.data()[0] = value.value();
+			} else if (value.typed())
+				d = value.typed_data().widen();
+			else if (value.packed())
+				d = value.packed_data();
+			else
+				throw std::invalid_argument("size mismatch");
+			source = typed_dense::from(d.view(), t.type());
+		}
+		if (shape.empty() ? source.count() != 1 : source.shape() != shape)
+			throw std::invalid_argument("size mismatch");
+		size_t element = element_size(t.type()), bytes = block * element;
+		char *out = t.data<char>();
+		for (size_t k = 0; k != offsets.size(); k++)
+			std::memcpy(out + offsets[k] * element, source.data<char>() + k * bytes,
+			            bytes);
+	}
+	// false when the value does not fit into the dense element in place
+	bool assign_element(object_view &dst, const object &value) {
+		if (!dst.packed()) {
+			dst[0] = value;
+			return true;
+		}
+		auto &v = dst.packed_data();
+		if (v.rank() == 1) {
+			if (!value.flat())
+				return false;
+			*v.row(0) = value.value();
+			return true;
+		}
+		auto element = object_view(v.sub(0));
+		if (!value.packed() || value.packed_data().shape() != v.sub(0).shape)
+			return false;
+		ops_impl::update(element, value);
+		return true;
+	}
+	std::map<char, size_t> priority{{'-', 1},  {'+', 1},  {'*', 3},
+	                                {'@', 3},  {')', 0},  {-'(', 0},
+	                                {-'-', 4}, {-'+', 4}};
+	std::map<char, bool> unary{{'(', true},  {'-', true},  {'+', true},
+	                           {'*', false}, {'@', false}, {')', false}};
+	std::map<char, bool> binary{{'(', false}, {'-', true}, {'+', true},
+	                            {'*', true},  {'@', true}, {')', true}};
+	// operands on the evaluation stack, dense ones are combined lazily; small
+	// ones are cheaper to compute right away with the fixed size kernels
+	using value = std::variant<object, lazy>;
+	static bool fusible(const value &v) {
+		if (std::holds_alternative<lazy>(v))
+			return true;
+		auto &o = std::get<object>(v);
+		return o.packed() && o.packed_data().count() > kernels::fixed::max;
+	}
+	static bool scalar(const value &v) {
+		return std::holds_alternative<object>(v) && std::get<object>(v).flat();
+	}
+	static lazy fuse(value v) {
+		if (auto *l = std::get_if<lazy>(&v))
+			return std::move(*l);
+		return lazy::hold(std::get<object>(std::move(v)));
+	}
+	object materialize(value v) {
+		auto *l = std::get_if<lazy>(&v);
+		if (!l)
+			return std::get<object>(std::move(v));
+		if (!tracing())
+			return l->eval();
+		auto start = trace::clock::now();
+		auto result = l->eval();
+		record({"eval", {}}, result, start);
+		return result;
+	}
+	value evaluate(opcode op, value a) {
+		if (!tracing())
+			return apply(op, std::move(a));
+		trace::event e{symbol(op), {shape_of(a)}};
+		auto start = trace::clock::now();
+		auto result = apply(op, std::move(a));
+		record(std::move(e), result, start);
+		return result;
+	}
+	value evaluate(opcode op, value a, value b) {
+		if (!tracing())
+			return apply(op, std::move(a), std::move(b));
+		trace::event e{symbol(op), {shape_of(a), shape_of(b)}};
+		auto start = trace::clock::now();
+		auto result = apply(op, std::move(a), std::move(b));
+		record(std::move(e), result, start);
+		return result;
+	}
+	object call(const builtins::builtin &fn, const std::vector<object> &args) {
+		if (!tracing())
+			return fn.fn(args);
+		trace::event e{fn.name};
+		for (auto &a : args)
+			e.operands.push_back(shape_of(a));
+		auto start = trace::clock::now();
+		auto result = fn.fn(args);
+		record(std::move(e), result, start);
+		return result;
+	}
+	// zeros shaped like o, its elements are never read
+	static object zeros_like(const object &o) {
+		if (o.flat())
+			return object(0.0);
+		if (o.packed())
+			return object(dense(o.packed_data().shape()));
+		if (o.sparse())
+			return object(sparse(o.sparse_data().rows(), o.sparse_data().columns()));
+		if (o.typed())
+			return object(typed_dense(o.typed_data().type(), o.typed_data().shape()));
+		object::container_impl result;
+		o.visit([&](auto &a) {
+			if constexpr (std::is_same_v<std::decay_t<decltype(a)>,
+			                             object::container_impl>)
+				for (auto &b : a)
+					result.push_back(zeros_like(b));
+		});
+		return object(std::move(result));
+	}
+	value apply(opcode op, value a) {
+		switch (op) {
+		case opcode::negate:
+			if (fusible(a))
+				return -fuse(std::move(a));
+			return object(-1) * materialize(std::move(a));
+		case opcode::zero:
+			if (auto *l = std::get_if<lazy>(&a))
+				return object(dense(l->shape()));
+			return zeros_like(std::get<object>(a));
+		default:
+			if (fusible(a))
+				return a;
+			return object(1) * materialize(std::move(a));
+		}
+	}
+	// operands of different shapes broadcast without fusing
+	static bool fusible(const value &a, const value &b) {
+		return fusible(a) && fusible(b) && shape_of(a) == shape_of(b);
+	}
+	value apply(opcode op, value a, value b) {
+		switch (op) {
+		case opcode::subtract:
+			if (fusible(a, b))
+				return fuse(std::move(a)) - fuse(std::move(b));
+			return materialize(std::move(a)) - materialize(std::move(b));
+		case opcode::add:
+			if (fusible(a, b))
+				return fuse(std::move(a)) + fuse(std::move(b));
+			return materialize(std::move(a)) + materialize(std::move(b));
+		case opcode::matmul:
+			return matmul(materialize(std::move(a)), materialize(std::move(b)));
+		default:
+			if (fusible(a) && scalar(b))
+				return fuse(std::move(a)) * std::get<object>(b).value();
+			if (scalar(a) && fusible(b))
+				return std::get<object>(a).value() * fuse(std::move(b));
+			return materialize(std::move(a)) * materialize(std::move(b));
+		}
+	}
+
+	std::shared_ptr<trace::hook> tracer = trace::from_env();
+	// where whos and trace on write
+	std::ostream *report = &std::cerr;
+	// trace events and whos output of a script statement running on a pool
+	// thread, passed on in line order once its level is done
+	struct line_output : trace::hook {
+		std::vector<trace::event> events;
+		std::ostringstream report;
+		void on_event(const trace::event &e) override { events.push_back(e); }
+	};
+	// set for the statement the calling thread runs, a nested one restores
+	// the outer one when it is done
+	class line_scope {
+	public:
+		explicit line_scope(line_output *line) : outer{current()} {
+			current() = line;
+		}
+		line_scope(const line_scope &) = delete;
+		line_scope &operator=(const line_scope &) = delete;
+		~line_scope() { current() = outer; }
+
+		static line_output *&current() {
+			thread_local line_output *instance = nullptr;
+			return instance;
+		}
+
+	private:
+		line_output *outer;
+	};
+	std::ostream &report_stream() {
+		auto *line = line_scope::current();
+		return line ? line->report : *report;
+	}
+	bool tracing() const {
+#ifdef MATLANG_NO_TRACE
+		return false;
+#else
+		return tracer != nullptr;
+#endif
+	}
+	// ragged containers report their outer length only
+	static shape_t shape_of(const value &v) {
+		if (auto *l = std::get_if<lazy>(&v))
+			return l->shape();
+		return shape_of(std::get<object>(v));
+	}
+	static shape_t shape_of(const object &o) {
+		if (o.flat())
+			return {};
+		if (o.packed())
+			return o.packed_data().shape();
+		if (o.sparse())
+			return o.sparse_data().shape();
+		if (o.typed())
+			return o.typed_data().shape();
+		return {o.size()};
+	}
+	void record(trace::event e, const value &result, trace::clock::time_point start) {
+		record(std::move(e), shape_of(result), start);
+	}
+	void record(trace::event e, shape_t result, trace::clock::time_point start) {
+		e.elapsed = trace::clock::now() - start;
+		e.result = std::move(result);
+		e.count = shape_count(e.result);
+		if (auto *line = line_scope::current())
+			line->on_event(e);
+		else
+			tracer->on_event(e);
+	}
+	static opcode operator_code(char oprtr) {
+		switch (oprtr) {
+		case '-':
+			return opcode::subtract;
+		case '+':
+			return opcode::add;
+		case '*':
+			return opcode::multiply;
+		case '@':
+			return opcode::matmul;
+		case -'-':
+			return opcode::negate;
+		default:
+			return opcode::identity;
+		}
+	}
+	// evaluates op on constants while compiling, false leaves it to run time
+	bool fold(const program &p, opcode op, size_t arg, std::vector<object> args,
+	          object &result) {
+		try {
+			switch (op) {
+			case opcode::pack:
+				result = object(object::container_impl(std::make_move_iterator(args.begin()),
+				                                       std::make_move_iterator(args.end())));
+				break;
+			case opcode::call:
+				result = p.calls[arg].fn->fn(args);
+				break;
+			case opcode::negate:
+			case opcode::identity:
+			case opcode::zero:
+				result = materialize(apply(op, std::move(args[0])));
+				break;
+			default:
+				result = materialize(apply(op, std::move(args[0]), std::move(args[1])));
+				break;
+			}
+		} catch (const std::exception &) {
+			return false;
+		}
+		return true;
+	}
+	void compile_impl(size_t &operands, std::stack<char> &operators, program &p,
+	                  size_t min_priority, parse_error err) {
+		while (operands != 0 && !operators.empty() &&
 		       ((priority[operators.top()] >= min_priority || min_priority == 0) &&
 		        (operators.top() != -'(' || min_priority != 0))) {
 			char oprtr = operators.top();
 			operators.pop();
-			auto oprnd = get(move(operands.top()));
-			operands.pop();
 			if (oprtr > 0) {
-				auto oprnd2 = get(move(operands.top()));
-				operands.pop();
-				operands.push(
-				    binary_evaluators[oprtr](std::move(oprnd2), std::move(oprnd)));
-			} else {
-				operands.push(unary_evaluators[oprtr](std::move(oprnd)));
+				if (operands < 2)
+					throw err;
+				operands--;
 			}
+			p.emit(operator_code(oprtr));
 		}
-		if (operands.empty() || operators.empty() ||
-		    (operators.top() != -'(' && min_priority == 0))
+		if (operators.empty() ||
+		    (min_priority == 0 && (operands == 0 || operators.top() != -'(')))
 			throw err;
 		if (min_priority == 0)
 			operators.pop();
 	}
-	size_t eval_expression(size_t start, const std::string &line, object &result) {
+	size_t compile_expression(size_t start, const std::string &line, program &p) {
 		size_t i = start;
-		std::stack<operand> operands;
+		size_t operands = 0;
 		std::stack<char> operators;
 		operators.push(-'(');
-		operand temp;
 		int state = 0; // 0: operator, 1: operand
+		size_t open = 0; // a ')' beyond these closes an enclosing call
 		while (i < line.size() && line[i] != ';' && line[i] != ',' &&
-		       line[i] != ']') {
+		       line[i] != ']' && (line[i] != ')' || open != 0)) {
 			char c = line[i];
 			if (unary[c] || binary[c]) {
 				if (state == 0 && !unary[c])
@@ -305,66 +674,637 @@ class parser {
 				if (state == 1 && !binary[c])
 					throw parse_error(i, "expression error");
 				if (c == ')') {
-					eval_impl(operands, operators, 0, parse_error(i, "expression error"));
+					compile_impl(operands, operators, p, 0,
+					             parse_error(i, "expression error"));
+					open--;
 					state = 1;
 				} else {
+					if (c == '(')
+						open++;
 					char oprtr = state == 0 ? -c : c;
 					if (c != '(')
-						eval_impl(operands, operators, priority[oprtr],
-						          parse_error(i, "expression error"));
+						compile_impl(operands, operators, p, priority[oprtr],
+						             parse_error(i, "expression error"));
 					operators.push(oprtr);
 					state = 0;
 				}
 				i++;
 			} else {
-				i = parse_operand(i, line, temp);
-				operands.push(move(temp));
+				i = compile_operand(i, line, p);
+				operands++;
 				state = 1;
 			}
 			i = implicit_space(i, line);
 		}
-		eval_impl(operands, operators, 0, parse_error(i, "expression error"));
-		if (operands.size() != 1)
+		compile_impl(operands, operators, p, 0, parse_error(i, "expression error"));
+		if (operands != 1)
 			throw parse_error(i, "expression error");
-		result = get(move(operands.top()));
 		return i;
 	}
-
-public:
-	void clear() { temp_vars.clear(); }
-	size_t eval(size_t start, const std::string &line, object &ov) {
+	std::shared_ptr<const program> compile(size_t start, const std::string &line) {
 		size_t i = start;
+		auto p = std::make_shared<program>();
 		i = implicit_space(i, line);
+		// `name[...] = expression;`, `name[...] += expression;` (also -= and
+		// *=), `name[...];` or `expression;`
+		size_t j = i;
 		view_link lvalue;
-		i = parse_view_link(i, line, lvalue);
-		i = implicit_space(i, line);
-		if (i < line.size() && line[i] == '=') {
-			i++;
-			i = implicit_space(i, line);
-			object result;
-			i = eval_expression(i, line, result);
-			if (i >= line.size() || line[i] != ';')
-				throw parse_error(i, ";");
-			i++;
-			if (lvalue.sl.size() != 0) {
-				auto src = get_view(move(operand(lvalue)));
-				if (src.size() == 1)
-					src[0] = result;
-				else
-					ops_impl::update(src, result);
+		if (i < line.size() && lexer::is_alpha(line[i]))
+			j = implicit_space(parse_view_link(i, line, lvalue), line);
+		bool compound = j + 1 < line.size() && line[j + 1] == '=' &&
+		                (line[j] == '+' || line[j] == '-' || line[j] == '*');
+		if (j != i && j < line.size() &&
+		    (line[j] == '=' || line[j] == ';' || compound)) {
+			p->target = p->add_link(vars.intern(lvalue.name), std::move(lvalue.sl));
+			if (compound) {
+				p->compound = true;
+				p->combine = operator_code(line[j++]);
+			}
+			if (line[j] == '=') {
+				i = implicit_space(j + 1, line);
+				i = compile_expression(i, line, *p);
+				p->assignment = true;
 			} else {
-				vars[lvalue.name] = result;
+				p->emit(opcode::load, p->target);
+				i = j;
 			}
-			ov = std::move(result);
-			return i;
-		}
-		i = implicit_space(i, line);
+		} else
+			i = compile_expression(i, line, *p);
 		if (i >= line.size() || line[i] != ';')
 			throw parse_error(i, ";");
 		i++;
-		ov = get(std::move(lvalue));
+		p->length = i - start;
+		optimize::run(*p, [&](opcode op, size_t arg, std::vector<object> args,
+		                      object &result) {
+			return fold(*p, op, arg, std::move(args), result);
+		});
+		return p;
+	}
+	// value stacks keep their capacity between statements. every run takes
+	// its own: a thread waiting on the pool inside one statement may run
+	// another one, and independent statements run concurrently
+	class stack_lease {
+	public:
+		stack_lease() {
+			auto &s = spare();
+			if (!s.empty()) {
+				stack = std::move(s.back());
+				s.pop_back();
+			}
+		}
+		stack_lease(const stack_lease &) = delete;
+		stack_lease &operator=(const stack_lease &) = delete;
+		// values left by an error must not keep storage shared
+		~stack_lease() {
+			stack.clear();
+			try {
+				spare().push_back(std::move(stack));
+			} catch (...) {
+			}
+		}
+
+		std::vector<value> stack;
+
+	private:
+		static std::vector<std::vector<value>> &spare() {
+			thread_local std::vector<std::vector<value>> instance;
+			return instance;
+		}
+	};
+	void run(const program &p, object &ov) {
+		auto resolve = [&](const program::link &l) -> object & {
+			return vars.at(l.slot);
+		};
+		stack_lease lease;
+		auto &stack = lease.stack;
+		stack.reserve(p.depth);
+		std::vector<value> temps(p.temps);
+		for (auto &ins : p.code) {
+			switch (ins.op) {
+			case opcode::constant:
+				stack.push_back(p.constants[ins.arg]);
+				break;
+			case opcode::load: {
+				auto &l = p.links[ins.arg];
+				auto &o = resolve(l);
+				// whole variables share their storage
+				if (!o.packed() || l.sl.empty()) {
+					stack.push_back(get(o, l.sl));
+					break;
+				}
+				auto selected = select(o.packed_data().view(), l.sl, 0);
+				if (selected.rank() == 0)
+					stack.push_back(object(*selected.data));
+				else
+					stack.push_back(lazy::ref(selected));
+				break;
+			}
+			case opcode::negate:
+			case opcode::identity:
+			case opcode::zero:
+				stack.back() = evaluate(ins.op, std::move(stack.back()));
+				break;
+			case opcode::add:
+			case opcode::subtract:
+			case opcode::multiply:
+			case opcode::matmul: {
+				auto b = std::move(stack.back());
+				stack.pop_back();
+				stack.back() = evaluate(ins.op, std::move(stack.back()), std::move(b));
+				break;
+			}
+			case opcode::pack: {
+				object::container_impl container;
+				for (auto it = stack.end() - ins.arg; it != stack.end(); it++)
+					container.push_back(materialize(std::move(*it)));
+				stack.resize(stack.size() - ins.arg);
+				stack.push_back(object(std::move(container)));
+				break;
+			}
+			case opcode::call: {
+				auto &c = p.calls[ins.arg];
+				std::vector<object> args;
+				args.reserve(c.argc);
+				for (auto it = stack.end() - c.argc; it != stack.end(); it++)
+					args.push_back(materialize(std::move(*it)));
+				stack.resize(stack.size() - c.argc);
+				stack.push_back(call(*c.fn, args));
+				break;
+			}
+			// shared subexpressions are evaluated once
+			case opcode::keep:
+				if (std::holds_alternative<lazy>(stack.back()))
+					stack.back() = materialize(std::move(stack.back()));
+				temps[ins.arg] = stack.back();
+				break;
+			case opcode::reuse:
+				stack.push_back(temps[ins.arg]);
+				break;
+			}
+		}
+		object result = materialize(std::move(stack.back()));
+		stack.clear();
+		if (p.assignment && p.compound) {
+			auto &l = p.links[p.target];
+			assign_compound(l, p.combine, std::move(result));
+			ov = get(resolve(l), l.sl);
+			return;
+		}
+		if (p.assignment) {
+			auto &l = p.links[p.target];
+			store(l, result);
+			// typed elements round what they take, yield what they kept
+			if (!l.sl.empty() && vars.at(l.slot).typed()) {
+				ov = get(vars.at(l.slot), l.sl);
+				return;
+			}
+		}
+		ov = std::move(result);
+	}
+	// target = result, or target[...] = result
+	void store(const program::link &l, const object &result) {
+		if (l.sl.size() == 0)
+			return vars.assign(l.slot, result);
+		auto &target = vars.at(l.slot);
+		if (target.sparse())
+			assign_sparse(target.sparse_data(), l.sl, result);
+		else if (target.typed())
+			assign_typed(target.typed_data(), l.sl, result);
+		else {
+			auto src = get_view(target, l.sl);
+			if (src.size() != 1)
+				ops_impl::update(src, result);
+			else if (!assign_element(src, result)) {
+				src = get_view(target, l.sl, 0, true);
+				src[0] = result;
+			}
+		}
+	}
+	// x op= value writes straight into the dense storage of x when the result
+	// keeps the shape of the part it updates, value broadcast over it if need
+	// be; anything else is x = x op value
+	void assign_compound(const program::link &l, opcode op, object value) {
+		auto &target = vars.at(l.slot);
+		if (target.packed() &&
+		    fits_in_place(select(target.packed_data().view(), l.sl, 0), op, value)) {
+			auto v = select(target.packed_data().mutable_view(), l.sl, 0);
+			if (!tracing())
+				return apply_in_place(v, op, value);
+			trace::event e{compound_symbol(op), {v.shape, shape_of(value)}};
+			auto start = trace::clock::now();
+			apply_in_place(v, op, value);
+			return record(std::move(e), v.shape, start);
+		}
+		if (target.typed() && value.flat() &&
+		    target.typed_data().type() == dtype::int64 &&
+		    typed_ops::keeps_type(target.typed_data(), value.value())) {
+			auto &t = target.typed_data();
+			if (!tracing()) {
+				apply_in_place(t, l.sl, op, value.value());
+				return;
+			}
+			auto start = trace::clock::now();
+			auto shape = apply_in_place(t, l.sl, op, value.value());
+			trace::event e{compound_symbol(op), {shape, {}}};
+			return record(std::move(e), std::move(shape), start);
+		}
+		object current = get(target, l.sl);
+		store(l, materialize(evaluate(op, std::move(current), std::move(value))));
+	}
+	static bool fits_in_place(const dense_view &v, opcode op, const object &value) {
+		if (value.flat())
+			return true;
+		if (v.rank() == 0 || op == opcode::multiply || !value.packed())
+			return false;
+		auto &shape = value.packed_data().shape();
+		return shape.size() <= v.rank() && broadcast_shape(v.shape, shape) == v.shape;
+	}
+	// int64 elements and a whole scalar, exact where reading an element out
+	// as float64 would round above 2^53; yields the shape of the part updated
+	static shape_t apply_in_place(typed_dense &t, const std::vector<slice> &sl,
+	                              opcode op, double y) {
+		shape_t shape = t.shape();
+		size_t block = t.count();
+		auto offsets = sl.empty() ? std::vector<size_t>{0} : t.pick(sl, 0, shape, block);
+		int64_t k = int64_t(y), *x = t.data<int64_t>();
+		for (size_t b : offsets)
+			for (size_t j = b; j != b + block; j++)
+				x[j] = op == opcode::add        ? typed_ops::wrap_add(x[j], k)
+				       : op == opcode::subtract ? typed_ops::wrap_subtract(x[j], k)
+				                                : typed_ops::wrap_multiply(x[j], k);
+		return shape;
+	}
+	static void apply_in_place(const dense_view &v, opcode op, const object &value) {
+		if (v.rank() == 0) {
+			double &x = *v.data;
+			double y = value.value();
+			x = op == opcode::add ? x + y : op == opcode::subtract ? x - y : x * y;
+			return;
+		}
+		if (op == opcode::multiply)
+			return ops_impl::scale_into(v, v, value.value());
+		double y = value.flat() ? value.value() : 0;
+		auto w = value.flat() ? ops_impl::scalar_view(y) : value.packed_data().view();
+		if (op == opcode::add)
+			ops_impl::broadcast_into(v, v, w, ops_impl::add_into);
+		else
+			ops_impl::broadcast_into(v, v, w, ops_impl::subtract_into);
+	}
+	static const char *compound_symbol(opcode op) {
+		switch (op) {
+		case opcode::add:
+			return "+=";
+		case opcode::subtract:
+			return "-=";
+		default:
+			return "*=";
+		}
+	}
+
+	// `name argument;` statements handled directly instead of compiled; a
+	// name followed by anything but an argument or the ';' is an ordinary
+	// variable, so `memory + 1;` and `memory += 1;` use one
+	using command = size_t (parser::*)(size_t, const std::string &, object &);
+	std::map<std::string, command, std::less<>> commands{
+	    {"threads", &parser::threads_command},
+	    {"memory", &parser::memory_command},
+	    {"whos", &parser::whos_command},
+	    {"trace", &parser::trace_command},
+	    {"save", &parser::save_command},
+	    {"load", &parser::load_command},
+	    {"import", &parser::import_command},
+	    {"stream", &parser::stream_command},
+	};
+	// the command line starts with and the position of its argument, nullptr
+	// for other statements
+	const command *find_command(size_t start, const std::string &line,
+	                            size_t &next) {
+		size_t i = implicit_space(start, line);
+		if (i >= line.size() || !lexer::is_alpha(line[i]))
+			return nullptr;
+		auto name = lexer::next(line, i);
+		auto cmd = commands.find(name.text);
+		next = implicit_space(name.end, line);
+		if (cmd == commands.end() || (next < line.size() && !starts_argument(line[next])))
+			return nullptr;
+		return &cmd->second;
+	}
+	static bool starts_argument(char c) {
+		return c == ';' || c == '"' || lexer::is_digit(c) || lexer::is_alpha(c);
+	}
+	size_t parse_command(size_t start, const std::string &line, object &ov) {
+		size_t next;
+		auto cmd = find_command(start, line, next);
+		return cmd ? (this->*(*cmd))(next, line, ov) : start;
+	}
+	// "text" without escapes
+	size_t parse_string(size_t start, const std::string &line,
+	                    std::string &result) {
+		auto t = lexer::next(line, start);
+		if (t.k == lexer::kind::invalid)
+			throw parse_error(line.size(), "\"");
+		if (t.k != lexer::kind::string)
+			throw parse_error(start, "string");
+		result.assign(t.text);
+		return t.end;
+	}
+	size_t expect_end(size_t start, const std::string &line) {
+		size_t i = implicit_space(start, line);
+		if (i >= line.size() || line[i] != ';')
+			throw parse_error(i, ";");
+		return i + 1;
+	}
+	// threads [n]; resizes the pool, yields the thread count
+	size_t threads_command(size_t start, const std::string &line, object &ov) {
+		size_t i = start;
+		if (i < line.size() && lexer::is_digit(line[i])) {
+			size_t n;
+			i = parse_index(i, line, n);
+			if (n == 0)
+				throw std::invalid_argument("thread count must be positive");
+			pool().resize(n);
+		}
+		i = expect_end(i, line);
+		ov = object(double(pool().size()));
+		return i;
+	}
+
+	// memory [bytes]; limits the storage in use by all values, 0 lifts the
+	// limit, buffer_pool caches blocks only below it. setting it empties the
+	// statement cache, whose constants count too, and every block cache;
+	// yields the bytes in use
+	size_t memory_command(size_t start, const std::string &line, object &ov) {
+		size_t i = start;
+		if (i < line.size() && lexer::is_digit(line[i])) {
+			size_t n;
+			i = parse_size(i, line, n);
+			cache.clear();
+			buffer_pool::set_limit(n);
+		}
+		i = expect_end(i, line);
+		ov = object(double(buffer_pool::in_use()));
+		return i;
+	}
+	// whos; lists the variables where trace writes, with their shape,
+	// elements and bytes, then the constants of cached statements and what
+	// buffer_pool holds against the limit; yields the bytes of the variables
+	size_t whos_command(size_t start, const std::string &line, object &ov) {
+		using trace::operator<<;
+		size_t i = expect_end(start, line);
+		std::ostringstream os;
+		size_t total = 0;
+		for (auto &[name, o] : vars.entries()) {
+			size_t bytes = o->footprint();
+			total += bytes;
+			os << name << ' ' << shape_of(*o) << ' ' << o->elements() << " elements "
+			   << bytes << " bytes" << (shares_storage(*o) ? " shared" : "") << '\n';
+		}
+		size_t constants = 0;
+		for (auto &entry : cache)
+			for (auto &c : entry.second->constants)
+				constants += c.footprint();
+		os << "total " << total << " bytes, statement cache " << constants
+		   << " bytes, " << buffer_pool::in_use() << " in use and "
+		   << buffer_pool::held() - buffer_pool::in_use() << " cached";
+		if (size_t limit = buffer_pool::limit())
+			os << " of " << limit;
+		report_stream() << os.str() << std::endl;
+		ov = object(double(total));
+		return i;
+	}
+	// storage a copy refers to as well, constants of cached statements count
+	static bool shares_storage(const object &o) {
+		return o.visit([](auto &a) {
+			using T = std::decay_t<decltype(a)>;
+			if constexpr (std::is_same_v<T, object::flat_impl>)
+				return false;
+			else if constexpr (std::is_same_v<T, object::container_impl>)
+				return std::any_of(a.begin(), a.end(), shares_storage);
+			else
+				return a.shared();
+		});
+	}
+
+	// trace on|off; switches the trace to the report stream, stderr unless
+	// set_report changed it, yields 1 while tracing
+	size_t trace_command(size_t start, const std::string &line, object &ov) {
+		std::string mode;
+		size_t i = parse_identifier(start, line, mode);
+		if (mode == "on")
+			tracer = std::make_shared<trace::stream_hook>(*report);
+		else if (mode == "off")
+			tracer = nullptr;
+		else
+			throw parse_error(start, "on or off");
+		i = expect_end(i, line);
+		ov = object(tracing() ? 1.0 : 0.0);
+		return i;
+	}
+
+	// save "file"; writes every variable, yields their number
+	size_t save_command(size_t start, const std::string &line, object &ov) {
+		std::string path;
+		size_t i = expect_end(parse_string(start, line, path), line);
+		auto entries = vars.entries();
+		workspace::save(path, entries);
+		ov = object(double(entries.size()));
+		return i;
+	}
+	// load "file"; maps the file and replaces variables of the same name
+	size_t load_command(size_t start, const std::string &line, object &ov) {
+		std::string path;
+		size_t i = expect_end(parse_string(start, line, path), line);
+		auto loaded = workspace::load(path);
+		for (auto &[name, o] : loaded)
+			vars.assign(vars.intern(name), std::move(o));
+		ov = object(double(loaded.size()));
 		return i;
 	}
+
+	// import name "file.csv"; reads a numeric table into a matrix, yields
+	// its number of rows
+	size_t import_command(size_t start, const std::string &line, object &ov) {
+		std::string name, path;
+		size_t i = parse_identifier(start, line, name);
+		i = expect_end(parse_string(implicit_space(i, line), line, path), line);
+		auto d = csv::read(path);
+		ov = object(double(d.size()));
+		vars.assign(vars.intern(name), object(std::move(d)));
+		return i;
+	}
+	// stream name "file.csv" rows: statement; assigns the table to name in
+	// blocks of at most rows rows and runs the statement after each, so only
+	// one block is in memory; yields the number of rows
+	size_t stream_command(size_t start, const std::string &line, object &ov) {
+		std::string name, path;
+		size_t i = parse_identifier(start, line, name), rows;
+		i = parse_string(implicit_space(i, line), line, path);
+		i = parse_index(implicit_space(i, line), line, rows);
+		if (rows == 0)
+			throw parse_error(i, "positive row count");
+		i = implicit_space(i, line);
+		if (i >= line.size() || line[i] != ':')
+			throw parse_error(i, ":");
+		auto p = compile(i + 1, line);
+		size_t slot = vars.intern(name), total = 0;
+		csv::reader r(path);
+		dense block;
+		object result;
+		while (r.next(rows, block)) {
+			total += block.size();
+			vars.assign(slot, object(std::move(block)));
+			run(*p, result);
+		}
+		ov = object(double(total));
+		return i + 1 + p->length;
+	}
+
+	// the printed result of fn(result), or "error: what"
+	template <typename Fn> static std::string respond_with(const Fn &fn) {
+		std::ostringstream os;
+		try {
+			object result;
+			fn(result);
+			os << result;
+		} catch (std::bad_variant_access &) {
+			os.str("error: Type mismatch");
+		} catch (std::exception &e) {
+			os.str(std::string("error: ") + e.what());
+		}
+		return os.str();
+	}
+
+	constexpr static size_t cache_limit = 4096;
+	std::map<std::string, std::shared_ptr<const program>, std::less<>> cache;
+
+public:
+	// receives an event per evaluated operation, nullptr turns tracing off
+	void set_trace(std::shared_ptr<trace::hook> hook) { tracer = std::move(hook); }
+	// whos and trace on write to os instead of stderr, os must outlive the
+	// parser or the next call
+	void set_report(std::ostream &os) { report = &os; }
+	// name becomes an ordinary identifier again
+	void remove_command(std::string_view name) {
+		if (auto it = commands.find(name); it != commands.end())
+			commands.erase(it);
+	}
+	void assign(std::string_view name, object o) {
+		vars.assign(vars.intern(name), std::move(o));
+	}
+	size_t eval(size_t start, const std::string &line, object &ov) {
+		std::string_view key(line);
+		key.remove_prefix(start);
+		auto cached = cache.find(key);
+		if (cached == cache.end()) {
+			if (size_t end = parse_command(start, line, ov); end != start)
+				return end;
+			if (cache.size() >= cache_limit)
+				cache.clear();
+			cached = cache.emplace(key, compile(start, line)).first;
+		}
+		auto p = cached->second;
+		run(*p, ov);
+		return start + p->length;
+	}
+	// one whole line as a statement, formatted like the prompt prints it
+	std::string respond(const std::string &line) {
+		return respond_with([&](object &result) {
+			if (eval(0, line, result) != line.size())
+				throw parse_error(line.size(), "unhandled error");
+		});
+	}
+
+	// a statement per line, run as if one after another: a statement waits for
+	// the earlier ones writing a variable it uses and for those using one it
+	// writes, commands wait for everything; the rest runs concurrently on the
+	// pool, level by level of the dependency graph, unless a memory limit is
+	// set. trace events and whos output follow line order. yields respond()
+	// of every line
+	std::vector<std::string> run_script(const std::vector<std::string> &lines) {
+		struct step {
+			std::shared_ptr<const program> p; // nullptr for commands
+			size_t level{};
+		};
+		std::vector<std::string> out(lines.size());
+		std::vector<step> steps(lines.size());
+		std::vector<std::vector<size_t>> levels;
+		std::vector<size_t> read_level, write_level;
+		size_t barrier = 0;
+		for (size_t i = 0; i != lines.size(); i++) {
+			auto &s = steps[i];
+			size_t next;
+			std::vector<size_t> reads, writes;
+			if (!find_command(0, lines[i], next)) {
+				try {
+					s.p = compile(0, lines[i]);
+					if (s.p->length != lines[i].size())
+						throw parse_error(s.p->length, "unhandled error");
+				} catch (std::exception &e) {
+					out[i] = std::string("error: ") + e.what();
+					continue;
+				}
+				for (auto &ins : s.p->code)
+					if (ins.op == opcode::load)
+						reads.push_back(s.p->links[ins.arg].slot);
+				// slice and compound assignments read the variable they update
+				if (s.p->assignment) {
+					auto &target = s.p->links[s.p->target];
+					writes.push_back(target.slot);
+					if (!target.sl.empty() || s.p->compound)
+						reads.push_back(target.slot);
+				}
+			}
+			read_level.resize(vars.size());
+			write_level.resize(vars.size());
+			s.level = barrier;
+			if (!s.p)
+				s.level = levels.size();
+			for (size_t slot : reads)
+				s.level = std::max(s.level, write_level[slot]);
+			for (size_t slot : writes)
+				s.level = std::max({s.level, write_level[slot], read_level[slot]});
+			for (size_t slot : reads)
+				read_level[slot] = std::max(read_level[slot], s.level + 1);
+			for (size_t slot : writes)
+				write_level[slot] = s.level + 1;
+			if (!s.p)
+				barrier = s.level + 1;
+			if (levels.size() <= s.level)
+				levels.resize(s.level + 1);
+			levels[s.level].push_back(i);
+		}
+		for (auto &level : levels) {
+			std::vector<line_output> outputs(level.size());
+			auto step = [&](size_t k) {
+				size_t i = level[k];
+				line_scope scope(&outputs[k]);
+				out[i] = respond_with([&](object &result) {
+					if (steps[i].p)
+						run(*steps[i].p, result);
+					else
+						parse_command(0, lines[i], result);
+				});
+			};
+			// under a memory limit the peaks of concurrent statements would add
+			// up, so whether one fails would depend on the thread count
+			if (buffer_pool::limit() != 0)
+				for (size_t k = 0; k != level.size(); k++)
+					step(k);
+			else
+				pool().parallel_for(level.size(), 1, [&](size_t begin, size_t end) {
+					for (size_t k = begin; k != end; k++)
+						step(k);
+				});
+			for (auto &o : outputs) {
+				for (auto &e : o.events)
+					if (tracer)
+						tracer->on_event(e);
+				if (auto text = o.report.str(); !text.empty())
+					*report << text << std::flush;
+			}
+		}
+		return out;
+	}
 };
 } // namespace matlang
 
@@ -0,0 +1,149 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+#include "builtins.hpp"
+#include "object.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace matlang {
+enum class opcode : unsigned char {
+	constant, // push constants[arg]
+	load,     // push the value behind links[arg]
+	negate,
+	identity,
+	add,
+	subtract,
+	multiply,
+	matmul,
+	pack, // replace arg topmost values with a container of them
+	call, // replace the arguments of calls[arg] with its result
+	zero, // zeros shaped like the topmost value
+	keep, // copy the topmost value into temporary arg
+	reuse, // push temporary arg
+};
+
+inline const char *symbol(opcode op) {
+	switch (op) {
+	case opcode::negate:
+		return "unary-";
+	case opcode::identity:
+		return "unary+";
+	case opcode::add:
+		return "+";
+	case opcode::subtract:
+		return "-";
+	case opcode::multiply:
+		return "*";
+	case opcode::matmul:
+		return "@";
+	case opcode::pack:
+		return "[]";
+	case opcode::call:
+		return "call";
+	case opcode::zero:
+		return "zero";
+	default:
+		return "?";
+	}
+}
+
+struct instruction {
+	opcode op;
+	size_t arg;
+};
+
+// compiled form of a single statement, variables are referenced by their
+// symbol_table slot
+struct program {
+	struct link {
+		size_t slot;
+		std::vector<slice> sl;
+	};
+	struct call {
+		const builtins::builtin *fn;
+		size_t argc;
+	};
+
+	std::vector<instruction> code;
+	std::vector<object> constants;
+	std::vector<link> links;
+	std::vector<call> calls;
+	size_t target{};
+	bool assignment{};
+	bool compound{}; // target combine= code
+	opcode combine{};
+	size_t depth{};
+	size_t temps{};
+	size_t length{};
+
+	size_t add_link(size_t slot, std::vector<slice> sl) {
+		links.push_back({slot, std::move(sl)});
+		return links.size() - 1;
+	}
+	void emit(opcode op, size_t arg = 0) {
+		code.push_back({op, arg});
+		switch (op) {
+		case opcode::constant:
+		case opcode::load:
+		case opcode::reuse:
+			current++;
+			break;
+		case opcode::add:
+		case opcode::subtract:
+		case opcode::multiply:
+		case opcode::matmul:
+			current--;
+			break;
+		case opcode::pack:
+			current -= arg - 1;
+			break;
+		case opcode::call:
+			current -= calls[arg].argc - 1;
+			break;
+		case opcode::keep:
+			temps = std::max(temps, arg + 1);
+			break;
+		default:
+			break;
+		}
+		depth = std::max(depth, current);
+	}
+	void emit_call(const builtins::builtin *fn, size_t argc) {
+		calls.push_back({fn, argc});
+		emit(opcode::call, calls.size() - 1);
+	}
+	void emit_constant(object o) {
+		constants.push_back(std::move(o));
+		emit(opcode::constant, constants.size() - 1);
+	}
+	// a literal made of constants only becomes a single constant
+	void emit_pack(size_t n) {
+		if (n > code.size() ||
+		    !std::all_of(code.end() - n, code.end(),
+		                 [](auto &a) { return a.op == opcode::constant; })) {
+			emit(opcode::pack, n);
+			return;
+		}
+		object::container_impl container(
+		    std::make_move_iterator(constants.end() - n),
+		    std::make_move_iterator(constants.end()));
+		constants.resize(constants.size() - n);
+		code.resize(code.size() - n);
+		current -= n;
+		emit_constant(object(std::move(container)));
+	}
+
+	// drops the code, constants and calls stay for re-emitting
+	void clear_code() {
+		code.clear();
+		current = depth = temps = 0;
+	}
+
+private:
+	size_t current{};
+};
+} // namespace matlang
+
+#endif /* end of include guard: PROGRAM_HPP */
@@ -0,0 +1,122 @@
+#ifndef REDUCE_HPP
+#define REDUCE_HPP
+
+#include "dense.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace matlang {
+// reductions over strided lines of doubles; sums are pairwise over blocks
+// with independent lanes, so the error grows with log n, and large inputs are
+// split in fixed chunks combined in order, so results do not depend on the
+// thread count
+namespace reduce {
+constexpr size_t lanes = 8;
+constexpr size_t block = 256;
+
+namespace impl {
+// sum of get(i) for i in [begin, begin + n)
+template <typename Get>
+double pairwise(size_t begin, size_t n, const Get &get) {
+	if (n > block) {
+		size_t half = n / 2 / lanes * lanes;
+		return pairwise(begin, half, get) + pairwise(begin + half, n - half, get);
+	}
+	double lane[lanes] = {};
+	size_t i = 0;
+	for (; i + lanes <= n; i += lanes)
+		for (size_t k = 0; k < lanes; k++)
+			lane[k] += get(begin + i + k);
+	for (; i < n; i++)
+		lane[i % lanes] += get(begin + i);
+	return ((lane[0] + lane[1]) + (lane[2] + lane[3])) +
+	       ((lane[4] + lane[5]) + (lane[6] + lane[7]));
+}
+template <typename Get, typename Op>
+double fold(size_t begin, size_t n, double init, const Get &get, const Op &op) {
+	double lane[lanes];
+	std::fill_n(lane, lanes, init);
+	size_t i = 0;
+	for (; i + lanes <= n; i += lanes)
+		for (size_t k = 0; k < lanes; k++)
+			lane[k] = op(lane[k], get(begin + i + k));
+	for (; i < n; i++)
+		lane[i % lanes] = op(lane[i % lanes], get(begin + i));
+	for (size_t k = 1; k < lanes; k++)
+		lane[0] = op(lane[0], lane[k]);
+	return lane[0];
+}
+
+template <typename Get> double sum(size_t n, const Get &get) {
+	return pool().parallel_reduce(
+	    n, thread_pool::grain, 0.0,
+	    [&](size_t b, size_t e) { return pairwise(b, e - b, get); },
+	    [](double a, double b) { return a + b; });
+}
+template <typename Get, typename Op>
+double fold(size_t n, double init, const Get &get, const Op &op) {
+	return pool().parallel_reduce(
+	    n, thread_pool::grain, init,
+	    [&](size_t b, size_t e) { return fold(b, e - b, init, get, op); }, op);
+}
+
+// NaN wins, like the elementwise ops propagate it
+inline double min_op(double a, double b) { return b < a || b != b ? b : a; }
+inline double max_op(double a, double b) { return b > a || b != b ? b : a; }
+inline double prod_op(double a, double b) { return a * b; }
+} // namespace impl
+
+// a line of n elements, stride apart
+struct line {
+	const double *data;
+	size_t n;
+	size_t stride;
+
+	template <typename Fn> decltype(auto) with(const Fn &fn) const {
+		const double *p = data;
+		if (stride == 1)
+			return fn([p](size_t i) { return p[i]; });
+		size_t s = stride;
+		return fn([p, s](size_t i) { return p[i * s]; });
+	}
+};
+
+inline double sum(const line &a) {
+	return a.with([&](auto get) { return impl::sum(a.n, get); });
+}
+inline double prod(const line &a) {
+	return a.with([&](auto get) { return impl::fold(a.n, 1.0, get, impl::prod_op); });
+}
+inline double min(const line &a) {
+	return a.with([&](auto get) {
+		return impl::fold(a.n, std::numeric_limits<double>::infinity(), get,
+		                  impl::min_op);
+	});
+}
+inline double max(const line &a) {
+	return a.with([&](auto get) {
+		return impl::fold(a.n, -std::numeric_limits<double>::infinity(), get,
+		                  impl::max_op);
+	});
+}
+inline double sum_squares(const line &a) {
+	return a.with([&](auto get) {
+		return impl::sum(a.n, [&](size_t i) {
+			double x = get(i);
+			return x * x;
+		});
+	});
+}
+inline double dot(const line &a, const line &b) {
+	return a.with([&](auto ga) {
+		return b.with([&](auto gb) {
+			return impl::sum(a.n, [&](size_t i) { return ga(i) * gb(i); });
+		});
+	});
+}
+} // namespace reduce
+} // namespace matlang
+
+#endif /* end of include guard: REDUCE_HPP */
@@ -0,0 +1,231 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "parser.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <set>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATLANG_SOCKETS 1
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace matlang {
+// statements over a local stream socket: every connection is a session with
+// its own variables, run by one of a fixed number of session threads while
+// the heavy loops share pool(); each line gets one line back, the result or "error: what", after
+// a "# " line for every line whos and trace wrote meanwhile
+namespace server {
+using variables = std::vector<std::pair<std::string, object>>;
+
+// a session starts with copies of the shared variables, dense ones keep
+// pointing at the same storage until the session writes to them. clients
+// cannot change the process wide settings or reach files with the rights of
+// the server, whos and trace on write to report, MATLANG_TRACE too
+inline void open_session(parser &p, const variables &shared,
+                         std::ostream &report) {
+	for (auto name : {"threads", "memory", "save", "load", "import", "stream"})
+		p.remove_command(name);
+	p.set_report(report);
+	if (trace::from_env())
+		p.set_trace(std::make_shared<trace::stream_hook>(report));
+	for (auto &[name, o] : shared)
+		p.assign(name, o);
+}
+
+#ifdef MATLANG_SOCKETS
+namespace impl {
+class connection {
+public:
+	explicit connection(int fd) : fd{fd} {}
+	connection(const connection &) = delete;
+	connection &operator=(const connection &) = delete;
+	~connection() { ::close(fd); }
+
+	// false once the peer is gone
+	bool read_line(std::string &line) {
+		size_t end;
+		while ((end = buffer.find('\n', scanned)) == std::string::npos) {
+			scanned = buffer.size();
+			char chunk[4096];
+			ssize_t n = ::recv(fd, chunk, sizeof chunk, 0);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			buffer.append(chunk, n);
+		}
+		line.assign(buffer, 0, end);
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		buffer.erase(0, end + 1);
+		scanned = 0;
+		return true;
+	}
+	bool write_line(std::string text) {
+		text += '\n';
+		for (size_t done = 0; done < text.size();) {
+			ssize_t n = ::send(fd, text.data() + done, text.size() - done, flags);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			done += n;
+		}
+		return true;
+	}
+
+private:
+#ifdef MSG_NOSIGNAL
+	constexpr static int flags = MSG_NOSIGNAL;
+#else
+	constexpr static int flags = 0;
+#endif
+	int fd;
+	std::string buffer;
+	size_t scanned{};
+};
+
+inline void session(int fd, std::shared_ptr<const variables> shared) {
+	connection c(fd);
+	std::ostringstream report;
+	parser p;
+	open_session(p, *shared, report);
+	std::string line;
+	while (c.read_line(line)) {
+		auto result = p.respond(line);
+		std::istringstream notes(report.str());
+		report.str("");
+		for (std::string note; std::getline(notes, note);)
+			if (!c.write_line("# " + note))
+				return;
+		if (!c.write_line(std::move(result)))
+			break;
+	}
+}
+
+// session threads taking accepted connections in turn. dispatch waits while
+// all of them are busy; closing ends the open connections and joins them
+class session_pool {
+public:
+	session_pool(size_t size, std::shared_ptr<const variables> shared)
+	    : shared{std::move(shared)} {
+		for (size_t k = 0; k != size; k++)
+			threads.emplace_back([this] { work(); });
+	}
+	session_pool(const session_pool &) = delete;
+	session_pool &operator=(const session_pool &) = delete;
+	~session_pool() {
+		{
+			std::lock_guard<std::mutex> lock(m);
+			closed = true;
+			for (int fd : open)
+				::shutdown(fd, SHUT_RDWR);
+			for (int fd : waiting)
+				::close(fd);
+			waiting.clear();
+		}
+		changed.notify_all();
+		for (auto &t : threads)
+			t.join();
+	}
+
+	void dispatch(int fd) {
+		std::unique_lock<std::mutex> lock(m);
+		changed.wait(lock, [&] { return idle > waiting.size(); });
+		waiting.push_back(fd);
+		changed.notify_all();
+	}
+
+private:
+	void work() {
+		std::unique_lock<std::mutex> lock(m);
+		while (true) {
+			idle++;
+			changed.notify_all();
+			changed.wait(lock, [&] { return closed || !waiting.empty(); });
+			idle--;
+			if (closed)
+				return;
+			int fd = waiting.front();
+			waiting.pop_front();
+			open.insert(fd);
+			lock.unlock();
+			session(fd, shared);
+			lock.lock();
+			open.erase(fd);
+		}
+	}
+
+	std::shared_ptr<const variables> shared;
+	std::vector<std::thread> threads;
+	std::mutex m;
+	std::condition_variable changed;
+	std::deque<int> waiting;
+	std::set<int> open; // shut down on close
+	size_t idle{};
+	bool closed{};
+};
+} // namespace impl
+
+// listens on path until accept fails, a stale socket file is replaced. only
+// the owner may connect; at most sessions connections are served at once,
+// further ones wait in the listen queue
+inline void serve(const std::string &path, variables shared,
+                  size_t sessions = 16) {
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof addr.sun_path)
+		throw std::invalid_argument{"socket path too long"};
+	path.copy(addr.sun_path, path.size());
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		throw std::invalid_argument{"cannot create socket"};
+	::unlink(path.c_str());
+	// nobody can connect before listen, so the mode is set in time
+	if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0 ||
+	    ::chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+	    ::listen(fd, SOMAXCONN) != 0) {
+		::close(fd);
+		throw std::invalid_argument{"cannot listen on " + path};
+	}
+	{
+		impl::session_pool workers(
+		    std::max<size_t>(sessions, 1),
+		    std::make_shared<const variables>(std::move(shared)));
+		while (true) {
+			int client = ::accept(fd, nullptr, nullptr);
+			if (client < 0 && errno == EINTR)
+				continue;
+			if (client < 0)
+				break;
+			workers.dispatch(client);
+		}
+	}
+	::close(fd);
+	throw std::invalid_argument{"accept failed on " + path};
+}
+#else
+inline void serve(const std::string &, variables, size_t = 16) {
+	throw std::invalid_argument{"sockets are not supported on this platform"};
+}
+#endif
+} // namespace server
+} // namespace matlang
+
+#endif /* end of include guard: SERVER_HPP */
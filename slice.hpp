@@ -2,12 +2,83 @@
 #define SLICE_HPP
 
 #include <algorithm>
+#include <initializer_list>
 #include <stdexcept>
 #include <utility>
 #include <vector>
 
 namespace matlang {
-using slice = std::vector<size_t>;
+// indices along one axis, either an explicit list or start + i * step
+class slice {
+public:
+	slice() = default;
+	slice(std::initializer_list<size_t> ids) : ids_(ids), count_{ids_.size()} {}
+	explicit slice(std::vector<size_t> ids)
+	    : ids_{std::move(ids)}, count_{ids_.size()} {}
+	static slice range(size_t start, size_t count, size_t step = 1) {
+		slice result;
+		result.range_ = true;
+		result.start_ = start;
+		result.count_ = count;
+		result.step_ = step;
+		return result;
+	}
+
+	bool is_range() const { return range_; }
+	bool empty() const { return count_ == 0; }
+	size_t size() const { return count_; }
+	size_t start() const { return range_ ? start_ : ids_[0]; }
+	size_t step() const { return step_; }
+	const size_t *ids() const { return ids_.data(); }
+	size_t operator[](size_t i) const {
+		return range_ ? start_ + i * step_ : ids_[i];
+	}
+	// largest index, requires a non-empty slice
+	size_t max() const {
+		if (range_)
+			return start_ + (count_ - 1) * step_;
+		return *std::max_element(ids_.begin(), ids_.end());
+	}
+	// indices of this slice picked by s, ranges of ranges stay ranges
+	slice select(const slice &s) const {
+		if (range_ && s.range_)
+			return range(start_ + s.start_ * step_, s.count_, step_ * s.step_);
+		std::vector<size_t> result(s.size());
+		for (size_t i = 0; i != result.size(); i++)
+			result[i] = (*this)[s[i]];
+		return slice(std::move(result));
+	}
+
+	friend bool operator==(const slice &l, const slice &r) {
+		if (l.size() != r.size())
+			return false;
+		for (size_t i = 0; i != l.size(); i++)
+			if (l[i] != r[i])
+				return false;
+		return true;
+	}
+
+	// explicit lists are parsed element by element, ranges expand in place
+	void push_back(const slice &s) {
+		if (empty() && !range_) {
+			*this = s;
+			return;
+		}
+		if (range_) {
+			range_ = false;
+			for (size_t i = 0; i != count_; i++)
+				ids_.push_back(start_ + i * step_);
+		}
+		for (size_t i = 0; i != s.size(); i++)
+			ids_.push_back(s[i]);
+		count_ = ids_.size();
+	}
+
+private:
+	std::vector<size_t> ids_{};
+	size_t start_{}, count_{}, step_{1};
+	bool range_{};
+};
 
 template <typename Container> struct slice_array {
 private:
@@ -18,18 +89,15 @@ public:
 	using value_type = typename Container::value_type;
 	slice_array() = default;
 	slice_array(Container &data, slice s) : container{&data}, sl{std::move(s)} {
-		if (std::find_if(sl.begin(), sl.end(),
-		                 [&](auto &el) { return el >= data.size(); }) != sl.end())
+		if (!sl.empty() && sl.max() >= data.size())
 			throw std::invalid_argument{"slice index out of bounds"};
 	}
 
 	value_type &operator[](size_t i) { return (*container)[sl[i]]; }
 	const value_type &operator[](size_t i) const { return (*container)[sl[i]]; }
-	// auto operator[](const slice &s) const {
-	// 	return slice_array<const slice_array>{this, s};
-	// }
 	auto size() const { return sl.size(); }
 
+	// a strided walk for ranges, an index walk for explicit lists
 	struct iterator {
 		using value_type = typename Container::iterator::value_type;
 		using reference = typename Container::iterator::reference;
@@ -37,18 +105,21 @@ public:
 		using difference_type = typename Container::iterator::difference_type;
 		using iterator_category = typename Container::iterator::iterator_category;
 
-		Container *container;
-		typename slice::const_iterator i;
+		value_type *base{};
+		const size_t *ids{};
+		difference_type step{}, pos{};
 		iterator() = default;
-		iterator(Container *c, typename slice::const_iterator it)
-		    : container{c}, i{it} {};
+		iterator(value_type *base, const size_t *ids, difference_type step,
+		         difference_type pos)
+		    : base{base}, ids{ids}, step{step}, pos{pos} {};
 		bool operator!=(const iterator &second) const {
-			return container != second.container || i != second.i;
+			return base != second.base || pos != second.pos;
 		}
-		auto &operator*() { return (*container)[*i]; }
-		auto &operator-> () { return (*container)[*i]; }
+		bool operator==(const iterator &second) const { return !(*this != second); }
+		reference operator*() const { return base[ids ? ids[pos] : pos * step]; }
+		value_type *operator->() const { return &**this; }
 		iterator &operator++() {
-			++i;
+			++pos;
 			return *this;
 		}
 		iterator operator++(int) {
@@ -57,16 +128,16 @@ public:
 			return temp;
 		}
 		iterator &operator--() {
-			--i;
+			--pos;
 			return *this;
 		}
 		iterator operator--(int) {
 			iterator temp = *this;
-			--temp;
+			--*this;
 			return temp;
 		}
 		iterator &operator+=(difference_type diff) {
-			i += diff;
+			pos += diff;
 			return *this;
 		}
 		iterator operator+(difference_type diff) const {
@@ -75,7 +146,7 @@ public:
 			return temp;
 		}
 		iterator &operator-=(difference_type diff) {
-			i -= diff;
+			pos -= diff;
 			return *this;
 		}
 		iterator operator-(difference_type diff) const {
@@ -83,17 +154,24 @@ public:
 			temp -= diff;
 			return temp;
 		}
-		auto operator-(iterator r) const { return i - r.i; }
-		auto operator[](difference_type diff) const { return *(*this + diff); }
-		auto operator<(iterator r) const { return i < r.i; }
-		auto operator<=(iterator r) const { return i <= r.i; }
-		auto operator>(iterator r) const { return i > r.i; }
-		auto operator>=(iterator r) const { return i >= r.i; }
+		auto operator-(iterator r) const { return pos - r.pos; }
+		reference operator[](difference_type diff) const { return *(*this + diff); }
+		auto operator<(iterator r) const { return pos < r.pos; }
+		auto operator<=(iterator r) const { return pos <= r.pos; }
+		auto operator>(iterator r) const { return pos > r.pos; }
+		auto operator>=(iterator r) const { return pos >= r.pos; }
 	};
-	auto begin() { return iterator{container, sl.begin()}; }
-	auto begin() const { return iterator{container, sl.begin()}; }
-	auto end() { return iterator{container, sl.end()}; }
-	auto end() const { return iterator{container, sl.end()}; }
+	auto begin() const { return at(0); }
+	auto end() const { return at(sl.size()); }
+
+private:
+	iterator at(size_t i) const {
+		using diff = typename iterator::difference_type;
+		if (!sl.is_range())
+			return {container->data(), sl.ids(), 0, diff(i)};
+		return {container->data() + (sl.empty() ? 0 : sl.start()), nullptr,
+		        diff(sl.step()), diff(i)};
+	}
 };
 } // namespace matlang
 
@@ -0,0 +1,142 @@
+#ifndef SMALL_VECTOR_HPP
+#define SMALL_VECTOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+
+namespace matlang {
+// vector of trivially copyable elements, the first N live inline so short
+// ones never allocate
+template <typename T, size_t N> class small_vector {
+	static_assert(std::is_trivially_copyable_v<T>);
+
+public:
+	using value_type = T;
+	using iterator = T *;
+	using const_iterator = const T *;
+
+	small_vector() = default;
+	explicit small_vector(size_t n) { resize(n); }
+	template <typename It, typename = std::enable_if_t<!std::is_integral_v<It>>>
+	small_vector(It first, It last) {
+		insert(end(), first, last);
+	}
+	small_vector(std::initializer_list<T> l) : small_vector(l.begin(), l.end()) {}
+	small_vector(const small_vector &o) {
+		if (o.heap_)
+			insert(end(), o.begin(), o.end());
+		else
+			copy_inline(o);
+	}
+	small_vector(small_vector &&o) noexcept { steal(o); }
+	small_vector &operator=(const small_vector &o) {
+		if (this == &o)
+			return *this;
+		if (!heap_ && !o.heap_)
+			copy_inline(o);
+		else {
+			size_ = 0;
+			insert(end(), o.begin(), o.end());
+		}
+		return *this;
+	}
+	small_vector &operator=(small_vector &&o) noexcept {
+		if (this != &o) {
+			release();
+			steal(o);
+		}
+		return *this;
+	}
+	~small_vector() { release(); }
+
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	T *data() { return heap_ ? heap_ : inline_; }
+	const T *data() const { return heap_ ? heap_ : inline_; }
+	T *begin() { return data(); }
+	T *end() { return data() + size_; }
+	const T *begin() const { return data(); }
+	const T *end() const { return data() + size_; }
+	T &operator[](size_t i) { return data()[i]; }
+	const T &operator[](size_t i) const { return data()[i]; }
+	T &back() { return data()[size_ - 1]; }
+	const T &back() const { return data()[size_ - 1]; }
+
+	void resize(size_t n) {
+		reserve(n);
+		if (n > size_)
+			std::fill(end(), data() + n, T{});
+		size_ = n;
+	}
+	void push_back(const T &v) {
+		reserve(size_ + 1);
+		data()[size_++] = v;
+	}
+	template <typename It> T *insert(const T *pos, It first, It last) {
+		size_t at = pos - begin(), n = std::distance(first, last);
+		reserve(size_ + n);
+		T *p = data() + at;
+		std::copy_backward(p, end(), end() + n);
+		std::copy(first, last, p);
+		size_ += n;
+		return p;
+	}
+	T *erase(const T *pos) {
+		T *p = begin() + (pos - begin());
+		std::copy(p + 1, end(), p);
+		size_--;
+		return p;
+	}
+
+	friend bool operator==(const small_vector &l, const small_vector &r) {
+		return std::equal(l.begin(), l.end(), r.begin(), r.end());
+	}
+	friend bool operator!=(const small_vector &l, const small_vector &r) {
+		return !(l == r);
+	}
+
+private:
+	void reserve(size_t n) {
+		if (n <= capacity_)
+			return;
+		size_t capacity = std::max(n, 2 * capacity_);
+		T *p = new T[capacity];
+		std::copy_n(data(), size_, p);
+		delete[] heap_;
+		heap_ = p;
+		capacity_ = capacity;
+	}
+	void release() {
+		delete[] heap_;
+		heap_ = nullptr;
+		capacity_ = N;
+		size_ = 0;
+	}
+	void steal(small_vector &o) {
+		if (o.heap_) {
+			heap_ = o.heap_;
+			capacity_ = o.capacity_;
+			o.heap_ = nullptr;
+			o.capacity_ = N;
+			size_ = o.size_;
+		} else
+			copy_inline(o);
+		o.size_ = 0;
+	}
+	// the whole fixed array, cheaper than a loop over size_ elements
+	void copy_inline(const small_vector &o) {
+		std::copy_n(o.inline_, N, inline_);
+		size_ = o.size_;
+	}
+
+	T *heap_{};
+	size_t size_{};
+	size_t capacity_{N};
+	T inline_[N]{};
+};
+} // namespace matlang
+
+#endif /* end of include guard: SMALL_VECTOR_HPP */
@@ -0,0 +1,414 @@
+#ifndef SPARSE_HPP
+#define SPARSE_HPP
+
+#include "dense.hpp"
+#include "slice.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace matlang {
+// compressed sparse rows: the nonzeros of row i are at [offsets[i],
+// offsets[i + 1]) of indices and values, in column order; copies share the
+// arrays until one of them is written, which are counted by buffer_pool
+class sparse {
+public:
+	// one nonzero in coordinate form, the way matrices are built
+	struct entry {
+		size_t row, column;
+		double value;
+	};
+
+	sparse() : sparse(0, 0) {}
+	sparse(size_t rows, size_t columns)
+	    : rows_{rows}, columns_{columns}, data_{std::make_shared<arrays>()} {
+		data_->offsets.assign(rows + 1, 0);
+	}
+	// adopts compressed arrays, they are checked for consistency
+	sparse(size_t rows, size_t columns, counted_vector<size_t> offsets,
+	       counted_vector<size_t> indices, counted_vector<double> values)
+	    : rows_{rows}, columns_{columns},
+	      data_{std::make_shared<arrays>(arrays{
+	          std::move(offsets), std::move(indices), std::move(values)})} {
+		auto &d = *data_;
+		if (d.offsets.size() != rows + 1 || d.offsets[0] != 0 ||
+		    d.offsets[rows] != d.values.size() || d.indices.size() != d.values.size())
+			throw std::invalid_argument{"inconsistent sparse matrix"};
+		for (size_t i = 0; i != rows; i++) {
+			if (d.offsets[i] > d.offsets[i + 1])
+				throw std::invalid_argument{"inconsistent sparse matrix"};
+			for (size_t p = d.offsets[i]; p != d.offsets[i + 1]; p++)
+				if (d.indices[p] >= columns ||
+				    (p != d.offsets[i] && d.indices[p] <= d.indices[p - 1]))
+					throw std::invalid_argument{"inconsistent sparse matrix"};
+		}
+	}
+	// repeated positions add up in the order given, zeros are dropped
+	static sparse from_entries(size_t rows, size_t columns, std::vector<entry> e);
+	// the nonzeros of a rank 2 view
+	static sparse from_dense(const dense_view &v);
+
+	size_t rows() const { return rows_; }
+	size_t columns() const { return columns_; }
+	size_t size() const { return rows_; }
+	shape_t shape() const { return {rows_, columns_}; }
+	size_t nnz() const { return data_->values.size(); }
+	bool shared() const { return data_.use_count() > 1; }
+	const counted_vector<size_t> &offsets() const { return data_->offsets; }
+	const counted_vector<size_t> &indices() const { return data_->indices; }
+	const counted_vector<double> &values() const { return data_->values; }
+
+	double at(size_t i, size_t j) const {
+		size_t p = find(i, j);
+		return p != none && data_->indices[p] == j ? data_->values[p] : 0.0;
+	}
+	void set(size_t i, size_t j, double v) {
+		check(i, j);
+		auto &d = mutable_data();
+		auto first = d.indices.begin() + d.offsets[i];
+		auto last = d.indices.begin() + d.offsets[i + 1];
+		size_t p = std::lower_bound(first, last, j) - d.indices.begin();
+		bool present = p != d.offsets[i + 1] && d.indices[p] == j;
+		if (present && v != 0) {
+			d.values[p] = v;
+			return;
+		}
+		if (present) {
+			d.indices.erase(d.indices.begin() + p);
+			d.values.erase(d.values.begin() + p);
+		} else if (v != 0) {
+			d.indices.insert(d.indices.begin() + p, j);
+			d.values.insert(d.values.begin() + p, v);
+		} else
+			return;
+		for (size_t k = i + 1; k <= rows_; k++)
+			if (present)
+				d.offsets[k]--;
+			else
+				d.offsets[k]++;
+	}
+	// row i becomes the elements of a rank 1 view of columns() elements
+	void set_row(size_t i, const dense_view &v) {
+		if (v.rank() != 1 || v.size() != columns_)
+			throw std::invalid_argument{"size mismatch"};
+		check_row(i);
+		std::vector<size_t> indices;
+		std::vector<double> values;
+		for (size_t j = 0; j != columns_; j++)
+			if (*v.row(j) != 0) {
+				indices.push_back(j);
+				values.push_back(*v.row(j));
+			}
+		auto &d = mutable_data();
+		size_t begin = d.offsets[i], end = d.offsets[i + 1];
+		d.indices.erase(d.indices.begin() + begin, d.indices.begin() + end);
+		d.values.erase(d.values.begin() + begin, d.values.begin() + end);
+		d.indices.insert(d.indices.begin() + begin, indices.begin(), indices.end());
+		d.values.insert(d.values.begin() + begin, values.begin(), values.end());
+		for (size_t k = i + 1; k <= rows_; k++)
+			d.offsets[k] = d.offsets[k] - (end - begin) + values.size();
+	}
+
+	// row i as a dense vector
+	dense row(size_t i) const {
+		check_row(i);
+		dense result({columns_});
+		double *out = result.data();
+		for (size_t p = data_->offsets[i]; p != data_->offsets[i + 1]; p++)
+			out[data_->indices[p]] = data_->values[p];
+		return result;
+	}
+	sparse select_rows(const slice &s) const {
+		if (!s.empty() && s.max() >= rows_)
+			throw std::invalid_argument{"index out of bounds"};
+		counted_vector<size_t> offsets{0}, indices;
+		counted_vector<double> values;
+		auto &d = *data_;
+		for (size_t k = 0; k != s.size(); k++) {
+			size_t i = s[k];
+			indices.insert(indices.end(), d.indices.begin() + d.offsets[i],
+			               d.indices.begin() + d.offsets[i + 1]);
+			values.insert(values.end(), d.values.begin() + d.offsets[i],
+			              d.values.begin() + d.offsets[i + 1]);
+			offsets.push_back(values.size());
+		}
+		sparse result(s.size(), columns_);
+		*result.data_ = {std::move(offsets), std::move(indices), std::move(values)};
+		return result;
+	}
+	dense to_dense() const {
+		dense result(shape());
+		double *out = result.data();
+		pool().parallel_for(rows_, rows_per_chunk(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				for (size_t p = data_->offsets[i]; p != data_->offsets[i + 1]; p++)
+					out[i * columns_ + data_->indices[p]] = data_->values[p];
+		});
+		return result;
+	}
+
+	// rows per pool chunk, about thread_pool::grain nonzeros each
+	static size_t rows_per_chunk(size_t rows, size_t nnz) {
+		size_t per_row = std::max<size_t>(1, nnz / std::max<size_t>(1, rows));
+		return std::max<size_t>(1, thread_pool::grain / per_row);
+	}
+	size_t rows_per_chunk() const { return rows_per_chunk(rows_, nnz()); }
+	// a matrix assembled row by row on the pool: emit(i, out) passes the
+	// nonzeros of row i in column order to out(column, value), zeros are dropped
+	template <typename Emit>
+	static sparse build(size_t rows, size_t columns, size_t step, const Emit &emit) {
+		size_t chunks = (rows + step - 1) / std::max<size_t>(step, 1);
+		std::vector<arrays> parts(chunks);
+		std::vector<size_t> counts(rows);
+		pool().parallel_for(chunks, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				auto &part = parts[c];
+				for (size_t i = c * step; i < std::min(rows, (c + 1) * step); i++) {
+					size_t before = part.values.size();
+					emit(i, [&](size_t j, double v) {
+						if (v != 0) {
+							part.indices.push_back(j);
+							part.values.push_back(v);
+						}
+					});
+					counts[i] = part.values.size() - before;
+				}
+			}
+		});
+		sparse result(rows, columns);
+		auto &d = *result.data_;
+		for (size_t i = 0; i != rows; i++)
+			d.offsets[i + 1] = d.offsets[i] + counts[i];
+		d.indices.reserve(d.offsets[rows]);
+		d.values.reserve(d.offsets[rows]);
+		for (auto &part : parts) {
+			d.indices.insert(d.indices.end(), part.indices.begin(), part.indices.end());
+			d.values.insert(d.values.end(), part.values.begin(), part.values.end());
+		}
+		return result;
+	}
+
+private:
+	struct arrays {
+		counted_vector<size_t> offsets, indices;
+		counted_vector<double> values;
+	};
+	constexpr static size_t none = ~size_t{0};
+
+	void check_row(size_t i) const {
+		if (i >= rows_)
+			throw std::invalid_argument{"index out of bounds"};
+	}
+	void check(size_t i, size_t j) const {
+		check_row(i);
+		if (j >= columns_)
+			throw std::invalid_argument{"index out of bounds"};
+	}
+	// first position of row i with a column not below j, none past the row
+	size_t find(size_t i, size_t j) const {
+		check(i, j);
+		auto &d = *data_;
+		auto first = d.indices.begin() + d.offsets[i];
+		auto last = d.indices.begin() + d.offsets[i + 1];
+		auto it = std::lower_bound(first, last, j);
+		return it == last ? none : it - d.indices.begin();
+	}
+	arrays &mutable_data() {
+		if (data_.use_count() > 1)
+			data_ = std::make_shared<arrays>(*data_);
+		return *data_;
+	}
+
+	size_t rows_, columns_;
+	std::shared_ptr<arrays> data_;
+};
+
+inline sparse sparse::from_entries(size_t rows, size_t columns,
+                                   std::vector<entry> e) {
+	std::vector<size_t> starts(rows + 1);
+	for (auto &a : e) {
+		if (a.row >= rows || a.column >= columns)
+			throw std::invalid_argument{"index out of bounds"};
+		starts[a.row + 1]++;
+	}
+	for (size_t i = 0; i != rows; i++)
+		starts[i + 1] += starts[i];
+	// bucketed by row keeping the given order, so duplicates sum the same way
+	std::vector<entry> by_row(e.size());
+	std::vector<size_t> next(starts.begin(), starts.end() - 1);
+	for (auto &a : e)
+		by_row[next[a.row]++] = a;
+	e = {};
+	return build(rows, columns, rows_per_chunk(rows, by_row.size()), [&](size_t i, const auto &out) {
+		auto first = by_row.begin() + starts[i], last = by_row.begin() + starts[i + 1];
+		std::stable_sort(first, last, [](const entry &a, const entry &b) {
+			return a.column < b.column;
+		});
+		while (first != last) {
+			size_t j = first->column;
+			double sum = 0;
+			for (; first != last && first->column == j; first++)
+				sum += first->value;
+			out(j, sum);
+		}
+	});
+}
+inline sparse sparse::from_dense(const dense_view &v) {
+	if (v.rank() != 2)
+		throw std::invalid_argument{"matrix operand expected"};
+	size_t columns = v.shape[1];
+	return build(v.size(), columns, std::max<size_t>(1, thread_pool::grain / columns),
+	             [&](size_t i, const auto &out) {
+		             const double *row = v.row(i);
+		             for (size_t j = 0; j != columns; j++)
+			             out(j, row[j * v.strides[1]]);
+	             });
+}
+
+// arithmetic on sparse operands, results that keep the zeros stay sparse
+namespace sparse_ops {
+inline void check_shape(const sparse &a, const shape_t &shape) {
+	if (a.shape() != shape)
+		throw std::invalid_argument{"size mismatch"};
+}
+// a + f * b
+inline sparse combine(const sparse &a, const sparse &b, double f) {
+	check_shape(a, b.shape());
+	auto &ao = a.offsets();
+	auto &bo = b.offsets();
+	auto &ai = a.indices();
+	auto &bi = b.indices();
+	auto &av = a.values();
+	auto &bv = b.values();
+	return sparse::build(a.rows(), a.columns(), a.rows_per_chunk(),
+	                     [&](size_t i, const auto &out) {
+		                     size_t p = ao[i], q = bo[i];
+		                     while (p != ao[i + 1] || q != bo[i + 1]) {
+			                     if (q == bo[i + 1] ||
+			                         (p != ao[i + 1] && ai[p] < bi[q])) {
+				                     out(ai[p], av[p]);
+				                     p++;
+			                     } else if (p == ao[i + 1] || bi[q] < ai[p]) {
+				                     out(bi[q], f * bv[q]);
+				                     q++;
+			                     } else {
+				                     out(ai[p], av[p] + f * bv[q]);
+				                     p++;
+				                     q++;
+			                     }
+		                     }
+	                     });
+}
+// the implicit zeros stay zero, also for infinite or NaN factors
+inline sparse scale(const sparse &a, double f) {
+	auto &o = a.offsets();
+	auto &idx = a.indices();
+	auto &v = a.values();
+	return sparse::build(a.rows(), a.columns(), a.rows_per_chunk(),
+	                     [&](size_t i, const auto &out) {
+		                     for (size_t p = o[i]; p != o[i + 1]; p++)
+			                     out(idx[p], f * v[p]);
+	                     });
+}
+// out += f * a for a rank 2 view of the same shape
+inline void add_into(const dense_view &out, const sparse &a, double f) {
+	check_shape(a, out.shape);
+	auto &o = a.offsets();
+	auto &idx = a.indices();
+	auto &v = a.values();
+	pool().parallel_for(a.rows(), a.rows_per_chunk(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			double *row = out.row(i);
+			for (size_t p = o[i]; p != o[i + 1]; p++)
+				row[idx[p] * out.strides[1]] += f * v[p];
+		}
+	});
+}
+
+// a[m x k] times a contiguous b of rank 1 (k) or 2 (k x n)
+inline dense multiply(const sparse &a, const dense &b) {
+	if (b.rank() > 2 || b.shape()[0] != a.columns())
+		throw std::invalid_argument{"size mismatch"};
+	size_t n = b.rank() == 1 ? 1 : b.shape()[1];
+	dense result(b.rank() == 1 ? shape_t{a.rows()} : shape_t{a.rows(), n});
+	auto &o = a.offsets();
+	auto &idx = a.indices();
+	auto &v = a.values();
+	const double *in = b.data();
+	double *y = result.data();
+	size_t step = std::max<size_t>(1, a.rows_per_chunk() / n);
+	pool().parallel_for(a.rows(), step, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			double *row = y + i * n;
+			for (size_t p = o[i]; p != o[i + 1]; p++) {
+				const double *from = in + idx[p] * n;
+				for (size_t j = 0; j != n; j++)
+					row[j] += v[p] * from[j];
+			}
+		}
+	});
+	return result;
+}
+// a contiguous a of rank 1 (k) or 2 (m x k) times b[k x n]
+inline dense multiply(const dense &a, const sparse &b) {
+	if (a.rank() > 2 || a.shape().back() != b.rows())
+		throw std::invalid_argument{"size mismatch"};
+	size_t m = a.rank() == 1 ? 1 : a.shape()[0], k = b.rows(), n = b.columns();
+	dense result(a.rank() == 1 ? shape_t{n} : shape_t{m, n});
+	auto &o = b.offsets();
+	auto &idx = b.indices();
+	auto &v = b.values();
+	const double *in = a.data();
+	double *y = result.data();
+	size_t per_row = std::max<size_t>(1, b.nnz());
+	pool().parallel_for(m, std::max<size_t>(1, thread_pool::grain / per_row),
+	                    [&](size_t begin, size_t end) {
+		                    for (size_t i = begin; i < end; i++) {
+			                    double *row = y + i * n;
+			                    for (size_t r = 0; r != k; r++) {
+				                    double x = in[i * k + r];
+				                    if (x == 0)
+					                    continue;
+				                    for (size_t p = o[r]; p != o[r + 1]; p++)
+					                    row[idx[p]] += x * v[p];
+			                    }
+		                    }
+	                    });
+	return result;
+}
+// row i of the product gathers the rows of b picked by row i of a
+inline sparse multiply(const sparse &a, const sparse &b) {
+	if (a.columns() != b.rows())
+		throw std::invalid_argument{"size mismatch"};
+	auto &ao = a.offsets();
+	auto &ai = a.indices();
+	auto &av = a.values();
+	auto &bo = b.offsets();
+	auto &bi = b.indices();
+	auto &bv = b.values();
+	return sparse::build(a.rows(), b.columns(), a.rows_per_chunk(),
+	                     [&](size_t i, const auto &out) {
+		                     std::vector<std::pair<size_t, double>> terms;
+		                     for (size_t p = ao[i]; p != ao[i + 1]; p++)
+			                     for (size_t q = bo[ai[p]]; q != bo[ai[p] + 1]; q++)
+				                     terms.emplace_back(bi[q], av[p] * bv[q]);
+		                     std::stable_sort(terms.begin(), terms.end(),
+		                                      [](auto &x, auto &y) {
+			                                      return x.first < y.first;
+		                                      });
+		                     for (size_t t = 0; t != terms.size();) {
+			                     size_t j = terms[t].first;
+			                     double sum = 0;
+			                     for (; t != terms.size() && terms[t].first == j; t++)
+				                     sum += terms[t].second;
+			                     out(j, sum);
+		                     }
+	                     });
+}
+} // namespace sparse_ops
+} // namespace matlang
+
+#endif /* end of include guard: SPARSE_HPP */
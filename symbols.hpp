@@ -0,0 +1,57 @@
+#ifndef SYMBOLS_HPP
+#define SYMBOLS_HPP
+
+#include "object.hpp"
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace matlang {
+// interned variable names, each owning one slot of a flat table; slots are
+// never reused, so compiled programs can keep them
+class symbol_table {
+public:
+	size_t intern(std::string_view name) {
+		auto it = ids.find(name);
+		if (it != ids.end())
+			return it->second;
+		ids.emplace(std::string(name), names.size());
+		names.emplace_back(name);
+		values.emplace_back();
+		return names.size() - 1;
+	}
+	const std::string &name(size_t slot) const { return names[slot]; }
+	size_t size() const { return names.size(); }
+
+	// nullptr while the variable is not assigned
+	object *find(size_t slot) {
+		return values[slot] ? &*values[slot] : nullptr;
+	}
+	object &at(size_t slot) {
+		if (!values[slot])
+			throw std::invalid_argument(names[slot] + " is not defined");
+		return *values[slot];
+	}
+	void assign(size_t slot, object o) { values[slot] = std::move(o); }
+
+	// assigned variables in name order
+	std::vector<std::pair<std::string_view, const object *>> entries() const {
+		std::vector<std::pair<std::string_view, const object *>> result;
+		for (auto &[name, slot] : ids)
+			if (values[slot])
+				result.emplace_back(name, &*values[slot]);
+		return result;
+	}
+
+private:
+	std::map<std::string, size_t, std::less<>> ids;
+	std::vector<std::string> names;
+	std::vector<std::optional<object>> values;
+};
+} // namespace matlang
+
+#endif /* end of include guard: SYMBOLS_HPP */
@@ -0,0 +1,20 @@
+#!/bin/sh
+# builds the interpreter and runs every test_*.sh next to this script with ML
+# set to the binary and TMP to a scratch directory; a test fails by exiting
+# with a non-zero status
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+${CXX:-g++} -std=c++17 -O2 -pthread "$dir/../main.cpp" -o "$work/matlang" || exit 1
+failed=0
+for t in "$dir"/test_*.sh; do
+	mkdir "$work/tmp"
+	if ML="$work/matlang" TMP="$work/tmp" sh "$t"; then
+		echo "pass $(basename "$t")"
+	else
+		echo "FAIL $(basename "$t")"
+		failed=1
+	fi
+	rm -rf "$work/tmp"
+done
+exit $failed
@@ -0,0 +1,28 @@
+# + and - stretch axes of length one and missing leading axes over the other
+# operand without copying them, scalars and one-element arrays included
+printf '%s\n' 'm = [[1,2,3],[4,5,6]];' 'm + [10,20,30];' '[10,20,30] - m;' \
+	'm + [[1],[2]];' '[[1],[2]] + [10,20,30];' '1 + m;' 'm - 1;' '[1] + m;' \
+	'm + [1,2];' 't = [[[1,2]],[[3,4]]];' 't + [10,20];' 't - [[1],[2]];' \
+	'-m + [1,1,1];' | "$ML" 2>&1 | tr -d '\010' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> [[1, 2, 3, ], [4, 5, 6, ], ]
+> [[11, 22, 33, ], [14, 25, 36, ], ]
+> [[9, 18, 27, ], [6, 15, 24, ], ]
+> [[2, 3, 4, ], [6, 7, 8, ], ]
+> [[11, 21, 31, ], [12, 22, 32, ], ]
+> [[2, 3, 4, ], [5, 6, 7, ], ]
+> [[0, 1, 2, ], [3, 4, 5, ], ]
+> [[2, 3, 4, ], [5, 6, 7, ], ]
+> size mismatch
+> [[[1, 2, ], ], [[3, 4, ], ], ]
+> [[[11, 22, ], ], [[13, 24, ], ], ]
+> [[[0, 1, ], [-1, 0, ], ], [[2, 3, ], [1, 2, ], ], ]
+> [[0, -1, -2, ], [-3, -4, -5, ], ]
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
+# rows broadcast over a matrix large enough for the pool, checked by sums
+printf '%s\n' 'a = full(sparse(1000, 500)) + 1;' 'r = sum(a, 0) - 999;' \
+	'sum(sum(a + r)) - sum(sum(a));' | "$ML" 2>&1 |
+	tr -d '\010' | sed -n 3p | grep -qx '> 500000' || exit 1
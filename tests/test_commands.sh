@@ -0,0 +1,23 @@
+# a command name followed by an operator is an ordinary variable, followed
+# by an argument or ';' it is the command
+printf '%s\n' 'memory = 1;' 'memory + 1;' 'memory += 1;' 'memory;' \
+	'whos = [1,2];' 'whos[0] * 2;' 'trace = 2;' 'trace - 1;' 'trace on;' \
+	'trace off;' | "$ML" 2>&1 | tr -d '\010' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> 1
+> 2
+> 2
+> 0
+> [1, 2, ]
+> 2
+> 2
+> 1
+> 1
+> 0
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
+# scripts tell them apart the same way
+printf '%s\n' 'threads = 3;' 'x = threads * 2;' 'x;' > "$TMP/s.txt"
+[ "$("$ML" --script "$TMP/s.txt" | tail -n 1)" = 6 ] || exit 1
@@ -0,0 +1,38 @@
+# x op= y updates in place, copies taken before keep their values, slices
+# and broadcast right sides included
+printf '%s\n' 'a = [1,2,3];' 'b = a * 1;' 'c = b;' 'b += 1;' 'c;' 'b[1] -= 5;' \
+	'b;' 'b *= 2;' 'm = full(sparse(2,3)) + 1;' 'n = m;' 'm += [1,2,3];' \
+	'm[0] -= [1,1,1];' 'm[1][2] *= 10;' 'm;' 'n;' 'm += [1,2];' 'x += 1;' \
+	's = 2;' 's *= 3;' 'l = [[1,2],[3]];' 'l[0] += 1;' 'l;' |
+	"$ML" 2>&1 | tr -d '\010' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> [1, 2, 3, ]
+> [1, 2, 3, ]
+> [1, 2, 3, ]
+> [2, 3, 4, ]
+> [1, 2, 3, ]
+> -2
+> [2, -2, 4, ]
+> [4, -4, 8, ]
+> [[1, 1, 1, ], [1, 1, 1, ], ]
+> [[1, 1, 1, ], [1, 1, 1, ], ]
+> [[2, 3, 4, ], [2, 3, 4, ], ]
+> [1, 2, 3, ]
+> 40
+> [[1, 2, 3, ], [2, 3, 40, ], ]
+> [[1, 1, 1, ], [1, 1, 1, ], ]
+> size mismatch
+> x is not defined
+> 2
+> 6
+> [[1, 2, ], [3, ], ]
+> [2, 3, ]
+> [[2, 3, ], [3, ], ]
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
+# a literal shares its storage with the cached statement, updating the
+# variable must not change what the statement yields next time
+printf '%s\n' 'v = [1,2];' 'v += 5;' 'v = [1,2];' | "$ML" 2>&1 | tr -d '\010' |
+	sed -n 3p | grep -qx '> \[1, 2, \]' || exit 1
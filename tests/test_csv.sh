@@ -0,0 +1,27 @@
+# rows are parsed straight into counted storage the whole-file matrix adopts,
+# so a limit a little above the data holds and one below it stops the import
+awk 'BEGIN { print "a,b"; for (i = 0; i < 600000; i++) printf "%d,%d\n", i, 2 * i }' > "$TMP/t.csv"
+printf '%s\n' "import x \"$TMP/t.csv\";" 'sum(sum(x));' 'whos;' |
+	"$ML" > "$TMP/import" 2>&1
+grep -qx '> 5.39999e+11' "$TMP/import" || exit 1
+grep -q 'x (600000,2) 1200000 elements 10485760 bytes$' "$TMP/import" || exit 1
+printf '%s\n' 'memory 9000000;' "import x \"$TMP/t.csv\";" |
+	"$ML" 2>&1 | grep -q 'memory limit of 9000000 bytes exceeded' || exit 1
+printf '%s\n' 'memory 12000000;' "import x \"$TMP/t.csv\";" |
+	"$ML" 2>&1 | grep -q 'exceeded' && exit 1
+# stream blocks are copied out of the same storage, blank lines skipped
+printf 'a,b\n\n1,2\n 3 , +4\n\n5,6\n' > "$TMP/s.csv"
+printf '%s\n' 'n = 0;' "stream y \"$TMP/s.csv\" 2: n = n + sum(sum(y));" 'n;' |
+	"$ML" 2>&1 | grep -qx '> 21' || exit 1
+printf '%s\n' 'n = 0;' "stream y \"$TMP/t.csv\" 70000: n = n + sum(sum(y));" 'n;' |
+	"$ML" 2>&1 | grep -qx '> 5.39999e+11' || exit 1
+printf '1,2\n3\n' > "$TMP/bad.csv"
+printf 'import b "%s";\n' "$TMP/bad.csv" | "$ML" 2>&1 |
+	grep -q 'bad.csv:2: 1 columns, expected 2' || exit 1
+# a header after blank lines is still skipped, line numbers count them all
+printf '\n  \na,b\n1,2\n\n3,4\n' > "$TMP/h.csv"
+printf 'import h "%s";\nh;\n' "$TMP/h.csv" | "$ML" 2>&1 | tr -d '\010' |
+	grep -qF '> [[1, 2, ], [3, 4, ], ]' || exit 1
+printf '\n  \na,b\n1,2\n\n3,x\n' > "$TMP/h.csv"
+printf 'import h "%s";\n' "$TMP/h.csv" | "$ML" 2>&1 |
+	grep -q 'h.csv:6: invalid number' || exit 1
@@ -0,0 +1,46 @@
+# blocked products against ones computed by awk, over sizes that leave
+# partial 4x8 register tiles and cross the cache blocks and the parallel cut
+gen() { # rows columns seed
+	awk -v m="$1" -v n="$2" -v s="$3" 'BEGIN {
+		for (i = 0; i < m; i++) {
+			line = ""
+			for (j = 0; j < n; j++)
+				line = line (j ? "," : "") ((i * 7 + j * 3 + s) % 11) - 5
+			print line
+		}
+	}'
+}
+product() { # a.csv b.csv
+	awk -F, 'NR == FNR { for (j = 1; j <= NF; j++) a[FNR, j] = $j; m = FNR; k = NF; next }
+		{ for (j = 1; j <= NF; j++) b[FNR, j] = $j; n = NF }
+		END {
+			for (i = 1; i <= m; i++) {
+				line = ""
+				for (j = 1; j <= n; j++) {
+					c = 0
+					for (p = 1; p <= k; p++)
+						c += a[i, p] * b[p, j]
+					line = line (j > 1 ? "," : "") c
+				}
+				print line
+			}
+		}' "$1" "$2"
+}
+: > "$TMP/s.txt"
+for size in "1 1 1" "3 5 2" "4 8 8" "5 9 13" "131 260 19" "7 3 2100" "200 300 150"; do
+	set -- $size
+	gen "$1" "$2" 1 > "$TMP/a$1.csv"
+	gen "$2" "$3" 2 > "$TMP/b$1.csv"
+	product "$TMP/a$1.csv" "$TMP/b$1.csv" > "$TMP/c$1.csv"
+	echo "import a \"$TMP/a$1.csv\";" >> "$TMP/s.txt"
+	echo "import b \"$TMP/b$1.csv\";" >> "$TMP/s.txt"
+	echo "import c \"$TMP/c$1.csv\";" >> "$TMP/s.txt"
+	echo "norm(c - a @ b);" >> "$TMP/s.txt"
+done
+for threads in 1 4; do
+	MATLANG_THREADS=$threads "$ML" --script "$TMP/s.txt" > "$TMP/out" || exit 1
+	[ "$(awk 'NR % 4 == 0' "$TMP/out" | sort -u)" = 0 ] || exit 1
+	[ "$(wc -l < "$TMP/out")" = 28 ] || exit 1
+done
+# a shape mismatch is refused
+printf '[[1,2],[3,4]] @ [1,2,3];\n' | "$ML" 2>&1 | grep -q 'mismatch' || exit 1
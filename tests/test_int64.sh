@@ -0,0 +1,14 @@
+# int64 elements and whole scalars stay exact above 2^53, wrapping around at
+# the ends of the range
+printf '%s\n' 'c = int64([9007199254740992,1]) + int64([1,1]);' 'c + 0;' \
+	'2 - c;' 'c -= 1;' 'c[0] += 3;' 'c;' 'n = int64([-9223372036854775808]) - 2;' |
+	"$ML" > "$TMP/int64" 2>&1
+for expected in '9007199254740993, 2' '-9007199254740991, 0' \
+	'9007199254740992, 1' '9007199254740995, 1' '9223372036854775806'; do
+	grep -qF "[$expected, " "$TMP/int64" || exit 1
+done
+# assigning into int64 elements yields the values they kept
+printf '%s\n' 'i = int64([1,2,3]);' 'i[1] = 2.7;' 'i[0:2] = [4.4, 5.6];' |
+	"$ML" > "$TMP/assign" 2>&1
+grep -qx '> 3' "$TMP/assign" || exit 1
+grep -qF '> [4, 6, ' "$TMP/assign" || exit 1
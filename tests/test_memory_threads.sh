@@ -0,0 +1,14 @@
+# blocks left in the caches of pool threads do not count against a limit
+# set later, the allocation that needs them succeeds
+{
+	echo 'a = full(sparse(1000, 1000));'
+	for k in 1 2 3 4 5 6 7 8; do
+		echo "s$k = sum(sum(a @ a + a * $k));"
+	done
+	echo 'memory 60000000;'
+	echo 'd = a * 3 - a;'
+	echo 'sum(sum(d));'
+} > "$TMP/script"
+MATLANG_THREADS=8 "$ML" --script "$TMP/script" > "$TMP/out" 2>&1 || exit 1
+[ "$(tail -n 1 "$TMP/out")" = 0 ] || exit 1
+! grep -q exceeded "$TMP/out"
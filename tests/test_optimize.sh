@@ -0,0 +1,30 @@
+# compiled statements fold constant subtrees, compute repeated subtrees once
+# and drop identities; the trace shows which operations still run
+printf '%s\n' 'a = full(sparse(2,2)) + 1;' 'b = a * 3;' 'trace on;' \
+	'x = [1,2] + [3,4] * 2;' 'y = sum(a + b) + sum(a + b);' \
+	'z = (a - b) @ (a - b);' 'w = 1 * a - 0;' 'u = b - b;' 'q = --a;' \
+	'r = 2 * 3 + a;' 'trace off;' | "$ML" 2>&1 | tr -d '\010' |
+	sed 's/ [0-9]*ns$//' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> [[1, 1, ], [1, 1, ], ]
+> [[3, 3, ], [3, 3, ], ]
+> 1
+> [7, 10, ]
+> + (2,2) (2,2) -> (2,2) 4 elements
+sum (2,2) -> () 1 elements
++ () () -> () 1 elements
+32
+> - (2,2) (2,2) -> (2,2) 4 elements
+@ (2,2) (2,2) -> (2,2) 4 elements
+[[8, 8, ], [8, 8, ], ]
+> [[1, 1, ], [1, 1, ], ]
+> zero (2,2) -> (2,2) 4 elements
+[[0, 0, ], [0, 0, ], ]
+> [[1, 1, ], [1, 1, ], ]
+> + () (2,2) -> (2,2) 4 elements
+[[7, 7, ], [7, 7, ], ]
+> 0
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
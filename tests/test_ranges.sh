@@ -0,0 +1,25 @@
+# start:stop[:step] slices stop before stop, read and write strided windows
+# and reject empty ranges and zero steps
+printf '%s\n' 'v = [0,1,2,3,4,5,6,7,8,9];' 'v[2:5];' 'v[0:10:3];' 'v[1:9:2];' \
+	'v[3:3];' 'v[0:11];' 'v[0:10:2] = [10,20,30,40,50];' 'v;' \
+	'm = [[1,2,3],[4,5,6],[7,8,9]];' 'm[0:3:2];' 'm[1][0:3:2];' 'v[0:4:0];' |
+	"$ML" 2>&1 | tr -d '\010' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, ]
+> [2, 3, 4, ]
+> [0, 3, 6, 9, ]
+> [1, 3, 5, 7, ]
+>        ^
+non-empty range expected at position 5
+> index out of bounds
+> [10, 20, 30, 40, 50, ]
+> [10, 1, 20, 3, 30, 5, 40, 7, 50, 9, ]
+> [[1, 2, 3, ], [4, 5, 6, ], [7, 8, 9, ], ]
+> [[1, 2, 3, ], [7, 8, 9, ], ]
+> [4, 6, ]
+>          ^
+positive step expected at position 7
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
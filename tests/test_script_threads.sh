@@ -0,0 +1,43 @@
+# statements waiting on the pool inside a reduction run other statements of
+# their level on the same thread, each must keep its own value stack
+awk 'BEGIN { for (i = 0; i < 200000; i++) print i % 7 "," i % 11 }' > "$TMP/x.csv"
+echo "import x \"$TMP/x.csv\";" > "$TMP/s.txt"
+for k in $(seq 1 32); do
+	echo "s$k = sum(x*$k+x) + sum(x+x*$k);" >> "$TMP/s.txt"
+done
+MATLANG_THREADS=1 "$ML" --script "$TMP/s.txt" > "$TMP/one" || exit 1
+for run in 1 2 3; do
+	MATLANG_THREADS=8 "$ML" --script "$TMP/s.txt" > "$TMP/many" || exit 1
+	cmp -s "$TMP/one" "$TMP/many" || exit 1
+done
+# trace events and whos output of a level come in line order
+{
+	echo 'a = full(sparse(300, 300));'
+	echo 'trace on;'
+	for k in 1 2 3 4; do
+		echo "p$k = a @ a;"
+		echo "q$k = -a;"
+		echo "r$k = sum(a - a * $k);"
+	done
+	echo 'whos;'
+} > "$TMP/t.txt"
+MATLANG_THREADS=1 "$ML" --script "$TMP/t.txt" 2>&1 > /dev/null |
+	sed 's/ [0-9]*ns$//; s/ and [0-9]* cached//' > "$TMP/one" || exit 1
+for run in 1 2 3; do
+	MATLANG_THREADS=8 "$ML" --script "$TMP/t.txt" 2>&1 > /dev/null |
+		sed 's/ [0-9]*ns$//; s/ and [0-9]* cached//' > "$TMP/many"
+	cmp -s "$TMP/one" "$TMP/many" || exit 1
+done
+# under a memory limit statements of a level run one after another, so
+# they fail or succeed whatever the thread count
+{
+	echo 'memory 60000000;'
+	echo 'a = full(sparse(1000, 1000));'
+	for k in 1 2 3 4 5 6 7 8; do
+		echo "s$k = sum(sum(a @ a + a * $k));"
+	done
+} > "$TMP/m.txt"
+MATLANG_THREADS=8 "$ML" --script "$TMP/m.txt" 2>&1 | grep -v '^\[\[' > "$TMP/many"
+MATLANG_THREADS=1 "$ML" --script "$TMP/m.txt" 2>&1 | grep -v '^\[\[' > "$TMP/one"
+cmp -s "$TMP/one" "$TMP/many" || exit 1
+! grep -q exceeded "$TMP/many"
@@ -0,0 +1,55 @@
+# sessions keep files and process settings to the server, get whos and the
+# MATLANG_TRACE trace back on the connection and need the rights of the
+# owner to connect
+command -v python3 > /dev/null || exit 0
+MATLANG_THREADS=2 MATLANG_TRACE=1 "$ML" --serve "$TMP/sock" 2> "$TMP/server.err" &
+server=$!
+trap 'kill $server 2> /dev/null' EXIT
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S "$TMP/sock" ] && break
+	sleep 0.2
+done
+[ "$(stat -c %a "$TMP/sock")" = 600 ] || exit 1
+python3 - "$TMP/sock" > "$TMP/session" <<'PY' || exit 1
+import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+f = s.makefile("rw")
+for line in ['save "x.mat";', 'import x "x.csv";', 'threads 1;',
+             'a = [1,2];', 'b = -a;', 'whos;']:
+    f.write(line + "\n")
+    f.flush()
+    while True:
+        reply = f.readline().rstrip("\n")
+        print(reply)
+        if not reply.startswith("# "):
+            break
+PY
+grep -q '^# a (2) 2 elements' "$TMP/session" || exit 1
+grep -q '^# unary- (2) -> (2)' "$TMP/session" || exit 1
+[ "$(grep -c '^error: ' "$TMP/session")" = 3 ] || exit 1
+[ ! -s "$TMP/server.err" ] || exit 1
+# idle connections beyond the session threads wait instead of taking a
+# thread each, and are served once one is free
+python3 - "$TMP/sock" "$server" <<'PY' || exit 1
+import os, socket, sys
+conns = []
+for k in range(100):
+    s = socket.socket(socket.AF_UNIX)
+    s.connect(sys.argv[1])
+    conns.append(s)
+s.sendall(b"1 + 1;\n")
+s.settimeout(0.5)
+try:
+    s.recv(100)
+    sys.exit("served beyond the session limit")
+except socket.timeout:
+    pass
+if len(os.listdir("/proc/%s/task" % sys.argv[2])) > 50:
+    sys.exit("a thread per connection")
+for c in conns[:-1]:
+    c.close()
+s.settimeout(5)
+if s.recv(100) != b"2\n":
+    sys.exit("not served after the others closed")
+PY
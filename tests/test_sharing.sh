@@ -0,0 +1,32 @@
+# copies share dense storage until one of them is written, the writer gets
+# its own buffer and the others keep their values; rows taken out of a
+# matrix do too
+printf '%s\n' 'a = [1,2,3] * 1;' 'b = a;' 'whos;' 'a[0] = 9;' 'b;' 'a;' 'whos;' \
+	'm = [[1,2],[3,4]] * 1;' 'r = m[1];' 'm[1][0] = 7;' 'r;' 'm;' 'c = m;' \
+	'c[0:2] = [[0,0],[0,0]];' 'm;' | "$ML" 2>&1 | tr -d '\010' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> [1, 2, 3, ]
+> [1, 2, 3, ]
+> a (3) 3 elements 64 bytes shared
+b (3) 3 elements 64 bytes shared
+total 128 bytes, statement cache 64 bytes, 64 in use and 0 cached
+128
+> 9
+> [1, 2, 3, ]
+> [9, 2, 3, ]
+> a (3) 3 elements 64 bytes
+b (3) 3 elements 64 bytes shared
+total 128 bytes, statement cache 64 bytes, 128 in use and 0 cached
+128
+> [[1, 2, ], [3, 4, ], ]
+> [3, 4, ]
+> 7
+> [3, 4, ]
+> [[1, 2, ], [7, 4, ], ]
+> [[1, 2, ], [7, 4, ], ]
+> [[0, 0, ], [0, 0, ], ]
+> [[1, 2, ], [7, 4, ], ]
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
@@ -0,0 +1,30 @@
+# compressed sparse rows: construction with repeated positions adding up,
+# products, elementwise operations, slicing and element assignment
+printf '%s\n' 'x = sparse(3,4,[0,1,2,0],[0,1,1,0],[5,6,7,1]);' 'nnz(x);' \
+	'full(x);' 'x[2];' 'x[1][1];' 'x[0:2];' 'x + x;' 'x - x;' 'x * 2;' \
+	'x @ [1,2,3,4];' '[1,1,1] @ x;' 'x @ sparse([[1,0],[0,1],[0,0],[2,0]]);' \
+	'sum(x);' 'x[1][1] = 9;' 'full(x);' 'x + 1;' 'sparse([[0,0],[3,0]]);' \
+	'x[3];' | "$ML" 2>&1 | tr -d '\010' > "$TMP/out"
+echo >> "$TMP/out"
+cat > "$TMP/expected" <<'OUT'
+> sparse(3, 4, [0, 1, 2], [0, 1, 1], [6, 6, 7])
+> 3
+> [[6, 0, 0, 0, ], [0, 6, 0, 0, ], [0, 7, 0, 0, ], ]
+> [0, 7, 0, 0, ]
+> 6
+> sparse(2, 4, [0, 1], [0, 1], [6, 6])
+> sparse(3, 4, [0, 1, 2], [0, 1, 1], [12, 12, 14])
+> sparse(3, 4)
+> sparse(3, 4, [0, 1, 2], [0, 1, 1], [12, 12, 14])
+> [6, 12, 14, ]
+> [6, 13, 0, 0, ]
+> sparse(3, 2, [0, 1, 2], [0, 1, 1], [6, 6, 7])
+> 19
+> 9
+> [[6, 0, 0, 0, ], [0, 9, 0, 0, ], [0, 7, 0, 0, ], ]
+> unsupported sparse operation
+> sparse(2, 2, [1], [0], [3])
+> index out of bounds
+> 
+OUT
+cmp -s "$TMP/out" "$TMP/expected" || exit 1
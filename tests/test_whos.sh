@@ -0,0 +1,15 @@
+# computed values own their storage until copied, literals share theirs with
+# the cached statement
+printf 'a = [1,2,3];\nb = a * 2;\nc = a * 3;\nd = c;\nwhos;\n' | "$ML" > /dev/null 2> "$TMP/whos"
+grep -qx 'a (3) 3 elements 64 bytes shared' "$TMP/whos" || exit 1
+grep -qx 'b (3) 3 elements 64 bytes' "$TMP/whos" || exit 1
+grep -qx 'c (3) 3 elements 64 bytes shared' "$TMP/whos" || exit 1
+grep -qx 'd (3) 3 elements 64 bytes shared' "$TMP/whos" || exit 1
+# limits of a gigabyte and more, checked before the allocation
+printf 'memory 4000000000;\nx = full(sparse(100000, 100000));\nmemory 0;\n' | "$ML" > "$TMP/limit" 2>&1
+grep -q 'memory limit of 4000000000 bytes exceeded' "$TMP/limit" || exit 1
+# blocks too large to cache are counted at their size, not their class
+printf 'x = full(sparse(3000, 3000));\nmemory 150000000;\ny = x * 2;\nsum(sum(y));\nwhos;\n' |
+	"$ML" 2>&1 | grep -v '^> \[\[' > "$TMP/large"
+grep -q 'exceeded' "$TMP/large" && exit 1
+grep -q 'y (3000,3000) 9000000 elements 72000000 bytes' "$TMP/large" || exit 1
@@ -0,0 +1,15 @@
+# a header asking for 2^32 - 1 dimensions is refused before the shape is
+# allocated, the memory cap turns that allocation into a failure
+printf 'MLWS\001\000\000\000\001\000\000\000\000\000\000\000\001\000\000\000x\002\377\377\377\377' > "$TMP/rank.ws"
+(ulimit -v 2000000; printf 'load "%s";\n' "$TMP/rank.ws" | "$ML") > "$TMP/rank" 2>&1
+grep -q 'corrupt workspace file' "$TMP/rank" || exit 1
+# saves to one path from two processes leave a complete file
+printf 'a = [1,2,3];\n' > "$TMP/saves"
+for i in $(seq 200); do
+	printf 'save "%s";\n' "$TMP/w.ws" >> "$TMP/saves"
+done
+"$ML" < "$TMP/saves" > /dev/null 2>&1 &
+"$ML" < "$TMP/saves" > /dev/null 2>&1
+wait
+printf 'load "%s";\na;\n' "$TMP/w.ws" | "$ML" 2>&1 | grep -q '\[1, 2, 3, ' || exit 1
+[ "$(ls "$TMP" | grep -c tmp)" = 0 ] || exit 1
@@ -0,0 +1,170 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace matlang {
+// work-stealing pool, the calling thread helps while it waits
+class thread_pool {
+public:
+	// elements per chunk of an elementwise loop
+	constexpr static size_t grain = size_t{1} << 15;
+
+	explicit thread_pool(size_t threads) { start(threads); }
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+	~thread_pool() { shutdown(); }
+
+	size_t size() const { return workers.size() + 1; }
+	void resize(size_t threads) {
+		shutdown();
+		start(threads);
+	}
+
+	// fn(begin, end) over [0, n) in chunks of step, boundaries depend on n only
+	template <typename Fn>
+	void parallel_for(size_t n, size_t step, const Fn &fn) {
+		step = std::max<size_t>(step, 1);
+		size_t chunks = (n + step - 1) / step;
+		if (chunks <= 1 || workers.empty()) {
+			if (n != 0)
+				fn(0, n);
+			return;
+		}
+		std::atomic<size_t> remaining{chunks};
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		for (size_t c = 0; c != chunks; c++)
+			push(c % queues.size(), [&, c] {
+				try {
+					fn(c * step, std::min(n, (c + 1) * step));
+				} catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+				remaining--;
+			});
+		{
+			// a worker between its empty check and its wait must not miss this
+			std::lock_guard<std::mutex> lock(sleep);
+		}
+		wake.notify_all();
+		while (remaining != 0)
+			if (!run_one(queues.size() - 1))
+				std::this_thread::yield();
+		if (error)
+			std::rethrow_exception(error);
+	}
+	// partial results per chunk combined in chunk order, so the result
+	// does not depend on the thread count
+	template <typename T, typename Map, typename Combine>
+	T parallel_reduce(size_t n, size_t step, T init, const Map &map,
+	                  const Combine &combine) {
+		step = std::max<size_t>(step, 1);
+		std::vector<T> partial((n + step - 1) / step, init);
+		parallel_for(n, step, [&](size_t begin, size_t end) {
+			partial[begin / step] = map(begin, end);
+		});
+		for (auto &a : partial)
+			init = combine(init, a);
+		return init;
+	}
+
+private:
+	using task = std::function<void()>;
+	struct queue {
+		std::mutex m;
+		std::deque<task> tasks;
+	};
+
+	void start(size_t threads) {
+		threads = std::max<size_t>(threads, 1);
+		stopping = false;
+		// one queue per worker plus one for outside callers
+		for (size_t i = 0; i != threads; i++)
+			queues.push_back(std::make_unique<queue>());
+		for (size_t i = 0; i + 1 < threads; i++)
+			workers.emplace_back([this, i] { work(i); });
+	}
+	void shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(sleep);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto &w : workers)
+			w.join();
+		workers.clear();
+		queues.clear();
+	}
+	void push(size_t q, task t) {
+		pending++;
+		std::lock_guard<std::mutex> lock(queues[q]->m);
+		queues[q]->tasks.push_back(std::move(t));
+	}
+	// own queue from the back, others from the front
+	bool run_one(size_t self) {
+		task t;
+		for (size_t i = 0; i != queues.size() && !t; i++) {
+			auto &q = *queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(q.m);
+			if (q.tasks.empty())
+				continue;
+			if (i == 0) {
+				t = std::move(q.tasks.back());
+				q.tasks.pop_back();
+			} else {
+				t = std::move(q.tasks.front());
+				q.tasks.pop_front();
+			}
+		}
+		if (!t)
+			return false;
+		pending--;
+		t();
+		return true;
+	}
+	void work(size_t self) {
+		while (true) {
+			if (run_one(self))
+				continue;
+			std::unique_lock<std::mutex> lock(sleep);
+			wake.wait(lock, [&] { return stopping || pending != 0; });
+			if (stopping)
+				return;
+		}
+	}
+
+	std::vector<std::unique_ptr<queue>> queues;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> pending{0};
+	std::mutex sleep;
+	std::condition_variable wake;
+	bool stopping{};
+};
+
+// MATLANG_THREADS overrides the hardware concurrency
+inline size_t default_threads() {
+	if (const char *env = std::getenv("MATLANG_THREADS"))
+		if (long n = std::atol(env); n > 0)
+			return n;
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+inline thread_pool &pool() {
+	static thread_pool instance(default_threads());
+	return instance;
+}
+} // namespace matlang
+
+#endif /* end of include guard: THREAD_POOL_HPP */
@@ -0,0 +1,66 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "dense.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace matlang {
+// instrumentation of evaluated operations, off unless a hook is installed,
+// defining MATLANG_NO_TRACE removes it at compile time
+namespace trace {
+using clock = std::chrono::steady_clock;
+
+struct event {
+	const char *op;
+	std::vector<shape_t> operands{}; // empty shape for a scalar
+	shape_t result{};
+	size_t count{}; // elements produced
+	std::chrono::nanoseconds elapsed{};
+};
+
+class hook {
+public:
+	virtual ~hook() = default;
+	virtual void on_event(const event &e) = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const shape_t &s) {
+	os << '(';
+	for (size_t d = 0; d != s.size(); d++)
+		os << (d ? "," : "") << s[d];
+	return os << ')';
+}
+inline std::ostream &operator<<(std::ostream &os, const event &e) {
+	os << e.op;
+	for (auto &s : e.operands)
+		os << ' ' << s;
+	return os << " -> " << e.result << ' ' << e.count << " elements "
+	          << e.elapsed.count() << "ns";
+}
+
+// one line per event
+class stream_hook : public hook {
+public:
+	explicit stream_hook(std::ostream &os) : os{os} {}
+	void on_event(const event &e) override { os << e << '\n'; }
+
+private:
+	std::ostream &os;
+};
+
+// MATLANG_TRACE=1 traces to stderr from the start
+inline std::shared_ptr<hook> from_env() {
+	if (const char *env = std::getenv("MATLANG_TRACE"))
+		if (std::atoi(env) > 0)
+			return std::make_shared<stream_hook>(std::cerr);
+	return nullptr;
+}
+} // namespace trace
+} // namespace matlang
+
+#endif /* end of include guard: TRACE_HPP */
@@ -0,0 +1,237 @@
+#ifndef TYPED_HPP
+#define TYPED_HPP
+
+#include "buffer_pool.hpp"
+#include "dense.hpp"
+#include "kernels.hpp"
+#include "slice.hpp"
+#include "thread_pool.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace matlang {
+// element types of dense storage, dense itself holds float64
+enum class dtype : unsigned char { float64, float32, int64 };
+
+inline size_t element_size(dtype t) {
+	return t == dtype::float32 ? sizeof(float) : sizeof(int64_t);
+}
+
+// dense elements kept as float32 or int64 in row-major order, half the
+// bandwidth or exact integers; copies share the buffer until one of them is
+// written
+class typed_dense {
+public:
+	typed_dense() = default;
+	// zeros
+	typed_dense(dtype type, shape_t shape)
+	    : type_{type}, shape_{std::move(shape)},
+	      buffer_{allocate(shape_count(shape_) * element_size(type))} {
+		if (type == dtype::float64)
+			throw std::invalid_argument{"float64 elements are dense"};
+		if (buffer_)
+			std::memset(buffer_.get(), 0, bytes_count());
+	}
+	// v rounded to type, int64 to the nearest integer
+	static typed_dense from(const dense_view &v, dtype type) {
+		dense source = v.contiguous() ? dense() : dense(v);
+		const double *in = v.contiguous() ? v.data : source.data();
+		typed_dense result(type, v.shape);
+		size_t n = result.count();
+		if (type == dtype::float32) {
+			float *out = result.data<float>();
+			pool().parallel_for(n, thread_pool::grain, [&](size_t b, size_t e) {
+				for (size_t j = b; j < e; j++)
+					out[j] = float(in[j]);
+			});
+		} else {
+			int64_t *out = result.data<int64_t>();
+			pool().parallel_for(n, thread_pool::grain, [&](size_t b, size_t e) {
+				for (size_t j = b; j < e; j++)
+					out[j] = to_int64(in[j]);
+			});
+		}
+		return result;
+	}
+	// a whole number in range
+	static int64_t to_int64(double v) {
+		constexpr double limit = 9223372036854775808.0; // 2^63
+		double r = std::round(v);
+		if (!(r >= -limit && r < limit))
+			throw std::invalid_argument{"value out of int64 range"};
+		return int64_t(r);
+	}
+
+	dtype type() const { return type_; }
+	const shape_t &shape() const { return shape_; }
+	size_t size() const { return shape_[0]; }
+	size_t rank() const { return shape_.size(); }
+	size_t count() const { return shape_count(shape_); }
+	size_t bytes_count() const { return count() * element_size(type_); }
+	bool shared() const { return buffer_.use_count() > 1; }
+	template <typename T> T *data() {
+		unshare();
+		return static_cast<T *>(buffer_.get());
+	}
+	template <typename T> const T *data() const {
+		return static_cast<const T *>(buffer_.get());
+	}
+	double element(size_t i) const {
+		if (type_ == dtype::float32)
+			return data<float>()[i];
+		return double(data<int64_t>()[i]);
+	}
+
+	// float64 copy for the operations without a typed path
+	dense widen() const {
+		dense result(shape_);
+		double *out = result.data();
+		pool().parallel_for(count(), thread_pool::grain, [&](size_t b, size_t e) {
+			if (type_ == dtype::float32)
+				std::copy(data<float>() + b, data<float>() + e, out + b);
+			else
+				for (size_t j = b; j < e; j++)
+					out[j] = double(data<int64_t>()[j]);
+		});
+		return result;
+	}
+
+	// sl[dim..] as dense objects take it: every slice but the last one is a
+	// single index, the last one picks blocks of `block` elements whose
+	// offsets are returned; shape is that of the selected part
+	std::vector<size_t> pick(const std::vector<slice> &sl, size_t dim,
+	                         shape_t &shape, size_t &block) const {
+		auto strides = contiguous_strides(shape_);
+		size_t base = 0, d = 0;
+		for (; dim + 1 < sl.size(); dim++, d++) {
+			if (sl[dim].max() >= shape_[d])
+				throw std::invalid_argument("index out of bounds");
+			if (sl[dim].size() != 1)
+				throw std::invalid_argument(
+				    "slices are allowed only on a final dimension");
+			if (d + 1 == rank())
+				throw std::invalid_argument("invalid dimension");
+			base += sl[dim][0] * strides[d];
+		}
+		auto &last = sl[dim];
+		if (last.max() >= shape_[d])
+			throw std::invalid_argument("index out of bounds");
+		block = strides[d];
+		std::vector<size_t> offsets(last.size());
+		for (size_t k = 0; k != last.size(); k++)
+			offsets[k] = base + last[k] * block;
+		shape = shape_t(shape_.begin() + d + 1, shape_.end());
+		if (size_t n = last.size(); n != 1)
+			shape.insert(shape.begin(), &n, &n + 1);
+		return offsets;
+	}
+
+private:
+	static std::shared_ptr<void> allocate(size_t bytes) {
+		return {buffer_pool::allocate(bytes),
+		        [bytes](void *p) { buffer_pool::release(p, bytes); }};
+	}
+	void unshare() {
+		if (!shared())
+			return;
+		auto copy = allocate(bytes_count());
+		std::memcpy(copy.get(), buffer_.get(), bytes_count());
+		buffer_ = std::move(copy);
+	}
+
+	dtype type_{dtype::float32};
+	shape_t shape_{};
+	std::shared_ptr<void> buffer_{};
+};
+
+// arithmetic on operands of one element type; int64 wraps around on overflow
+// like the hardware does
+namespace typed_ops {
+inline int64_t wrap_add(int64_t a, int64_t b) {
+	return int64_t(uint64_t(a) + uint64_t(b));
+}
+inline int64_t wrap_subtract(int64_t a, int64_t b) {
+	return int64_t(uint64_t(a) - uint64_t(b));
+}
+inline int64_t wrap_multiply(int64_t a, int64_t b) {
+	return int64_t(uint64_t(a) * uint64_t(b));
+}
+
+// a + b, or a - b
+inline typed_dense combine(const typed_dense &a, const typed_dense &b,
+                           bool subtract) {
+	if (a.type() != b.type() || a.shape() != b.shape())
+		throw std::invalid_argument{"size mismatch"};
+	typed_dense result(a.type(), a.shape());
+	if (a.type() == dtype::float32) {
+		float *out = result.data<float>();
+		const float *x = a.data<float>(), *y = b.data<float>();
+		pool().parallel_for(a.count(), thread_pool::grain, [&](size_t begin, size_t end) {
+			if (subtract)
+				kernels::subtract(out + begin, x + begin, y + begin, end - begin);
+			else
+				kernels::add(out + begin, x + begin, y + begin, end - begin);
+		});
+	} else {
+		int64_t *out = result.data<int64_t>();
+		const int64_t *x = a.data<int64_t>(), *y = b.data<int64_t>();
+		pool().parallel_for(a.count(), thread_pool::grain, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; j++)
+				out[j] = subtract ? wrap_subtract(x[j], y[j]) : wrap_add(x[j], y[j]);
+		});
+	}
+	return result;
+}
+// float32 takes any factor, int64 whole ones only
+inline bool keeps_type(const typed_dense &a, double f) {
+	if (a.type() == dtype::float32)
+		return true;
+	return f == std::floor(f) && std::abs(f) < 9223372036854775808.0;
+}
+// requires keeps_type(a, f)
+inline typed_dense scale(const typed_dense &a, double f) {
+	typed_dense result(a.type(), a.shape());
+	if (a.type() == dtype::float32) {
+		float *out = result.data<float>();
+		const float *x = a.data<float>();
+		pool().parallel_for(a.count(), thread_pool::grain, [&](size_t begin, size_t end) {
+			kernels::scale(out + begin, x + begin, float(f), end - begin);
+		});
+	} else {
+		int64_t *out = result.data<int64_t>();
+		const int64_t *x = a.data<int64_t>();
+		int64_t k = int64_t(f);
+		pool().parallel_for(a.count(), thread_pool::grain, [&](size_t begin, size_t end) {
+			for (size_t j = begin; j < end; j++)
+				out[j] = wrap_multiply(x[j], k);
+		});
+	}
+	return result;
+}
+// a + f, or f - a when negate; int64 only, requires keeps_type(a, f). the
+// sum stays exact where going through float64 would round above 2^53
+inline typed_dense shift(const typed_dense &a, double f, bool negate) {
+	if (a.type() != dtype::int64)
+		throw std::invalid_argument{"int64 elements only"};
+	typed_dense result(a.type(), a.shape());
+	int64_t *out = result.data<int64_t>();
+	const int64_t *x = a.data<int64_t>();
+	int64_t k = int64_t(f);
+	pool().parallel_for(a.count(), thread_pool::grain, [&](size_t begin, size_t end) {
+		if (negate)
+			for (size_t j = begin; j < end; j++)
+				out[j] = wrap_subtract(k, x[j]);
+		else
+			for (size_t j = begin; j < end; j++)
+				out[j] = wrap_add(x[j], k);
+	});
+	return result;
+}
+} // namespace typed_ops
+} // namespace matlang
+
+#endif /* end of include guard: TYPED_HPP */
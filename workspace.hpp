@@ -0,0 +1,328 @@
+#ifndef WORKSPACE_HPP
+#define WORKSPACE_HPP
+
+#include "object.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MATLANG_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace matlang {
+// binary workspace files, all integers and doubles little-endian:
+//   header  "MLWS" u32 version u64 variables
+//   entry   u32 name length, name, node
+//   node    u8 kind, then a double (flat), u64 length + nodes (ragged)
+//           or u32 rank + u64 shape, zero padding to 64 bytes, doubles (dense)
+//           or u64 rows, columns, nonzeros + u64 row offsets, u64 column
+//           indices, doubles (sparse, copied on load)
+//           or u8 element type, u32 rank + u64 shape, elements (typed, copied
+//           on load)
+// dense data is 64-byte aligned in the file, so a mapped file is used in place
+namespace workspace {
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "workspace files are little-endian");
+
+constexpr char magic[4] = {'M', 'L', 'W', 'S'};
+constexpr uint32_t version = 1;
+constexpr size_t alignment = aligned_buffer::alignment;
+enum class kind : uint8_t { flat, ragged, dense, sparse, typed };
+
+namespace impl {
+class writer {
+public:
+	explicit writer(const std::string &path) : os{path, std::ios::binary} {
+		if (!os)
+			throw std::invalid_argument{"cannot open " + path};
+	}
+	template <typename T> void put(T v) { bytes(&v, sizeof v); }
+	void bytes(const void *p, size_t n) {
+		os.write(static_cast<const char *>(p), n);
+		offset += n;
+	}
+	void pad() {
+		static const char zero[alignment] = {};
+		bytes(zero, (alignment - offset % alignment) % alignment);
+	}
+	void node(const object &o) {
+		o.visit([&](auto &a) { node(a); });
+	}
+	void node(double d) {
+		put(kind::flat);
+		put(d);
+	}
+	void node(const object::container_impl &c) {
+		put(kind::ragged);
+		put(uint64_t(c.size()));
+		for (auto &a : c)
+			node(a);
+	}
+	void node(const dense &d) {
+		put(kind::dense);
+		put(uint32_t(d.rank()));
+		for (auto n : d.shape())
+			put(uint64_t(n));
+		pad();
+		bytes(d.data(), d.count() * sizeof(double));
+	}
+	void node(const sparse &s) {
+		put(kind::sparse);
+		put(uint64_t(s.rows()));
+		put(uint64_t(s.columns()));
+		put(uint64_t(s.nnz()));
+		for (auto p : s.offsets())
+			put(uint64_t(p));
+		for (auto j : s.indices())
+			put(uint64_t(j));
+		bytes(s.values().data(), s.nnz() * sizeof(double));
+	}
+	void node(const typed_dense &t) {
+		put(kind::typed);
+		put(uint8_t(t.type()));
+		put(uint32_t(t.rank()));
+		for (auto n : t.shape())
+			put(uint64_t(n));
+		bytes(t.data<char>(), t.bytes_count());
+	}
+	void finish() {
+		os.close();
+		if (!os)
+			throw std::invalid_argument{"write failed"};
+	}
+
+private:
+	std::ofstream os;
+	size_t offset{};
+};
+
+class reader {
+public:
+	reader(const char *base, size_t size, std::shared_ptr<const void> owner)
+	    : base{base}, size{size}, owner{std::move(owner)} {}
+	template <typename T> T get() {
+		T v;
+		std::memcpy(&v, take(sizeof v), sizeof v);
+		return v;
+	}
+	std::string name() {
+		auto n = get<uint32_t>();
+		return std::string(take(n), n);
+	}
+	object node(size_t depth = 0) {
+		if (depth > max_depth)
+			throw corrupt();
+		switch (get<kind>()) {
+		case kind::flat:
+			return object(get<double>());
+		case kind::ragged: {
+			auto n = get<uint64_t>();
+			if (n > size - offset)
+				throw corrupt();
+			object::container_impl c;
+			c.reserve(n);
+			for (uint64_t i = 0; i != n; i++)
+				c.push_back(node(depth + 1));
+			return object(std::move(c));
+		}
+		case kind::dense: {
+			shape_t shape(rank());
+			size_t count = 1;
+			for (auto &n : shape) {
+				n = get<uint64_t>();
+				if (n == 0 || count > (size - offset) / n)
+					throw corrupt();
+				count *= n;
+			}
+			if (shape.empty())
+				throw corrupt();
+			take((alignment - offset % alignment) % alignment);
+			if (count > (size - offset) / sizeof(double))
+				throw corrupt();
+			// the mapping is private, writes never reach the file
+			auto data = reinterpret_cast<double *>(const_cast<char *>(take(0)));
+			take(count * sizeof(double));
+			return object(dense(std::move(shape), aligned_buffer(data, count, owner)));
+		}
+		case kind::typed: {
+			auto type = dtype(get<uint8_t>());
+			if (type != dtype::float32 && type != dtype::int64)
+				throw corrupt();
+			shape_t shape(rank());
+			size_t count = element_size(type);
+			for (auto &n : shape) {
+				n = get<uint64_t>();
+				if (n == 0 || count > (size - offset) / n)
+					throw corrupt();
+				count *= n;
+			}
+			if (shape.empty() || count > size - offset)
+				throw corrupt();
+			typed_dense result(type, std::move(shape));
+			std::memcpy(result.data<char>(), take(count), count);
+			return object(std::move(result));
+		}
+		case kind::sparse: {
+			auto rows = get<uint64_t>(), columns = get<uint64_t>();
+			auto nnz = get<uint64_t>();
+			if (rows >= (size - offset) / sizeof(uint64_t) ||
+			    nnz > (size - offset) / (sizeof(uint64_t) + sizeof(double)))
+				throw corrupt();
+			auto offsets = array<uint64_t, size_t>(rows + 1);
+			auto indices = array<uint64_t, size_t>(nnz);
+			auto values = array<double, double>(nnz);
+			try {
+				return object(sparse(rows, columns, std::move(offsets), std::move(indices),
+				                     std::move(values)));
+			} catch (const std::invalid_argument &) {
+				throw corrupt();
+			}
+		}
+		default:
+			throw corrupt();
+		}
+	}
+	bool done() const { return offset == size; }
+
+private:
+	// checked against the bytes left before a shape of that size exists
+	uint32_t rank() {
+		auto n = get<uint32_t>();
+		if (n > (size - offset) / sizeof(uint64_t))
+			throw corrupt();
+		return n;
+	}
+	template <typename T, typename U> counted_vector<U> array(size_t n) {
+		if (n > (size - offset) / sizeof(T))
+			throw corrupt();
+		counted_vector<U> result(n);
+		for (auto &v : result)
+			v = get<T>();
+		return result;
+	}
+	constexpr static size_t max_depth = 256;
+	static std::invalid_argument corrupt() {
+		return std::invalid_argument{"corrupt workspace file"};
+	}
+	const char *take(size_t n) {
+		if (n > size - offset)
+			throw corrupt();
+		const char *p = base + offset;
+		offset += n;
+		return p;
+	}
+
+	const char *base;
+	size_t size, offset{};
+	std::shared_ptr<const void> owner;
+};
+
+// whole file as private writable memory, mapped where possible
+inline reader open(const std::string &path) {
+#ifdef MATLANG_MMAP
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::invalid_argument{"cannot open " + path};
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		throw std::invalid_argument{"cannot read " + path};
+	}
+	size_t size = st.st_size;
+	void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p != MAP_FAILED) {
+		std::shared_ptr<const void> owner(p, [size](const void *q) {
+			::munmap(const_cast<void *>(q), size);
+		});
+		return reader(static_cast<const char *>(p), size, std::move(owner));
+	}
+#endif
+	std::ifstream is{path, std::ios::binary | std::ios::ate};
+	if (!is)
+		throw std::invalid_argument{"cannot open " + path};
+	size_t bytes = is.tellg();
+	aligned_buffer buffer((bytes + sizeof(double) - 1) / sizeof(double));
+	is.seekg(0);
+	is.read(reinterpret_cast<char *>(buffer.data()), bytes);
+	if (!is)
+		throw std::invalid_argument{"cannot read " + path};
+	auto owned = std::make_shared<const aligned_buffer>(std::move(buffer));
+	return reader(reinterpret_cast<const char *>(owned->data()), bytes, owned);
+}
+
+// next to path and different for every call, so saves to one path from
+// several threads or processes do not write into each other's file
+inline std::string temp_name(const std::string &path) {
+	static std::atomic<unsigned long> calls{};
+	std::string temp = path + ".tmp";
+#ifdef MATLANG_MMAP
+	temp += '.' + std::to_string(::getpid());
+#endif
+	return temp + '.' + std::to_string(calls++);
+}
+} // namespace impl
+
+// written aside and renamed, a mapping of the old file stays valid
+inline void save(
+    const std::string &path,
+    const std::vector<std::pair<std::string_view, const object *>> &vars) {
+	std::string temp = impl::temp_name(path);
+	try {
+		impl::writer w{temp};
+		w.bytes(magic, sizeof magic);
+		w.put(version);
+		w.put(uint64_t(vars.size()));
+		for (auto &[name, o] : vars) {
+			w.put(uint32_t(name.size()));
+			w.bytes(name.data(), name.size());
+			w.node(*o);
+		}
+		w.finish();
+	} catch (...) {
+		std::remove(temp.c_str());
+		throw;
+	}
+	if (std::rename(temp.c_str(), path.c_str()) != 0) {
+		std::remove(temp.c_str());
+		throw std::invalid_argument{"cannot write " + path};
+	}
+}
+
+// dense variables borrow the mapped file until they are reassigned
+inline std::vector<std::pair<std::string, object>>
+load(const std::string &path) {
+	auto r = impl::open(path);
+	char m[sizeof magic];
+	for (auto &c : m)
+		c = r.get<char>();
+	if (std::memcmp(m, magic, sizeof magic) != 0)
+		throw std::invalid_argument{path + " is not a workspace file"};
+	if (r.get<uint32_t>() != version)
+		throw std::invalid_argument{"unsupported workspace version"};
+	std::vector<std::pair<std::string, object>> result;
+	for (auto n = r.get<uint64_t>(); n != 0; n--) {
+		auto name = r.name();
+		result.emplace_back(std::move(name), r.node());
+	}
+	if (!r.done())
+		throw std::invalid_argument{"corrupt workspace file"};
+	return result;
+}
+} // namespace workspace
+} // namespace matlang
+
+#endif /* end of include guard: WORKSPACE_HPP */